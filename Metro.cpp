@@ -8,21 +8,88 @@
 #include<string>
 #include<algorithm>
 #include<sstream>
-#include<unordered_set>
+#include<cmath>
+#include<thread>
+#include<atomic>
+#include<mutex>
+#include<condition_variable>
+#include<deque>
+#include<functional>
+#include<list>
+#include<unordered_map>
+#include<memory>
+#include<cstdint>
+#include<cstring>
+#include<cstdio>
+#include<cstdlib>
+#include<chrono>
+#include<map>
+#include<set>
+#include<random>
+#include<iomanip>
+#include<future>
+#ifdef _WIN32
+#define NOMINMAX
+#include<windows.h>
+#else
+#include<sys/mman.h>
+#include<sys/stat.h>
+#include<sys/socket.h>
+#include<sys/un.h>
+#include<fcntl.h>
+#include<unistd.h>
+#include<csignal>
+#include<cerrno>
+#endif
+#if defined(__AVX__)
+#include<immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include<emmintrin.h>
+#endif
 
 #define INF INFINITY                // INF means infinity
-#define MAX_ROUTE_LEN 1000          // maximum number of stations in a shortest path
+#define CACHE_LINE 64               // size of a cache line in bytes, tables of Floyd algorithm are aligned to it
+#define FLOYD_BLOCK 64              // side length of a tile in blocked Floyd algorithm, must be a multiple of 8
+#define MAX_LINE_NUM 256            // maximum number of different line names in a txt file, must be a multiple of 64
+#define SNAPSHOT_MAGIC "METROSNP"   // first 8 bytes of a binary snapshot
+#define SNAPSHOT_VERSION 5          // add 1 whenever the layout of binary snapshots changes
+#define TRANSFER_PENALTY 2000       // default cost of a transfer in line-aware search, calculated by m
+#define WITNESS_LIMIT 500           // maximum number of stations settled by a witness search in contraction hierarchies
+#define TREE_CACHE_SIZE 64          // maximum number of shortest path trees cached in Dijkstra mode
+#define BATCH_WINDOW 1024           // number of source stations computed in parallel before their results are written in batch mode
+#define SERVICE_PIPELINE 256        // maximum number of requests of a connection being answered at the same time in service mode
+#define SERVICE_LINE_LIMIT 8192     // maximum bytes of a request line in service mode, a connection sending a longer one is closed
+#define SERVICE_CONNECTIONS 64      // maximum number of connections served at the same time, more wait in the backlog of the socket
+#define MAX_ALTERNATIVES 16         // maximum number of alternative routes asked for by a request in service mode
+#define TRAIN_SPEED 10              // mean speed of trains between stations by timetables (stops included), calculated by m/s
+#define BENCH_FLOYD_LIMIT 4000      // benchmarks skip Floyd algorithm on networks with more stations, since it costs O(n^3)
+#define BENCH_TABLE_LIMIT 16000     // benchmarks skip all-pairs tables (f/p/s) on networks with more stations, since they cost O(n^2) memory
+#define CHECK_QUERIES 200           // random queries of each engine in every step of the self-check
+#define CHECK_CHANGES 20            // random changes made on each engine by the self-check
+#define CHECK_STATIONS 500          // stations of the synthetic network checked when no file is given to the self-check
+#define COMPACT_TABLES 1            // 1 stores all-pairs tables as uint32_t metres and uint16_t stations when the network allows it
+#define COMPACT_INF 0x3fffffffu     // unreachable in compact tables, the sum of two entries never overflows a signed 32-bit integer
+#define COMPACT_NONE 0xffff         // no previous station in compact tables, thus at most 65535 stations
+#define METRICS 1                   // 1 counts phases, searches and allocations for export, 0 compiles the instrumentation away
 #define DEFAULT_SRC "Beijing.txt"
 /*
-* DEFAULT_SRC is the file position of metro data, by default it's configured in the same directory as executable file (.exe).
-* Edit it if you want to switch to another city or configure directory.
+* DEFAULT_SRC is the file position of metro data used when no other file is given,
+* by default it's configured in the same directory as executable file (.exe).
 */
 
-using namespace std;
+#if METRICS
+// time the rest of the scope as a phase
+#define METRIC_PHASE(metrics, phase) MetroMetrics::PhaseTimer phaseTimer(metrics, MetroMetrics::phase)
+// add to a counter of MetroMetrics, or to a plain counter of a query which is added to MetroMetrics when the query ends
+#define METRIC_COUNT(metrics, counter, n) (metrics).add(MetroMetrics::counter, n)
+#define METRIC_ADD(counter, n) ((counter) += (n))
+#else
+#define METRIC_PHASE(metrics, phase)
+#define METRIC_COUNT(metrics, counter, n) ((void)0)
+#define METRIC_ADD(counter, n) ((void)0)
+#endif
 
-static string fileSrc;     // string variable for file position of metro data
-static int init_len;       // length of the array to record shortest path, used in the function Metro::routeRecur
-static char alg;           // algorithm chosen, d - Dijkstra, f - Floyd, used in user API functions
+using namespace std;
 
 // exception class
 class valueException : public logic_error
@@ -51,866 +118,6537 @@ public:
 	}
 };
 
-// main class
-class Metro
+// thread pool shared by parallel algorithms
+// each worker owns a deque of tasks, and steals tasks from the other workers when its own deque is empty
+class WorkStealingPool
 {
 private:
-	// declare 2 basic structures to store data about station/route
-	struct Station;
-	struct Route;
-	// 2 vectors to store station and route data
-	vector<Station> stat;
-	vector<Route> rout;
-
-	// The following two vectors store original data about distance and path between two stations.
-	// They are square 2D vectors!
-
-	// origDis[i][j] means distance from i to j
-	// default value: 0 when i=j, or else infinity
-	vector<vector<double>> origDis;
-	// origPath[i][j] means the number of the station you need to pass when moving from i to j
-	// default value: i when i=j, or else -1
-	vector<vector<int>> origPath;
-
-	/*
-	* Two double pointers to store data in the process of Dijkstra or Floyd algorithm and the result.
-	*
-	* - Why I don't choose vector or unique_ptr?
-	* - Algorithms above is complicated. Therefore, when using vector to visit elements, it has a very low efficiency.
-	* - Therefore double pointer is the best choice for efficiency.
-	* - On my own computer, when using vector for Floyd algorithm, program crashed down after computing for several minutes.
-	*/
-	double **leastDis;
-	int **path;
-
-	// The following are small useful tool functions.
-
-	// search by the name of station and return the sequence number
-	int searchStatNum(const string&);
-	// get the name of a station by its sequence number
-	string getStatName(int);
-	// search by name of a station, when it exists then return sequence number, or else create a new station named this and return its number
-	int newStation(const string&);
-	// add a new "edge" for a square 2D vector, which means the side length of the 2D vector adds 1
-	template<typename T>
-	void newEdge(vector<vector<T>>&, T);
-	// delete an "edge" in a square 2D vector, which means delete a certain row and col whose sequence number is the same
-	template<typename T>
-	void delEdge(vector<vector<T>>&, int);
-	// calculate how many lines are there in a txt file
-	int calTxtLine(ifstream&)const;
-	// copy data from a vector to a 2-dimension array
-	template<typename T>
-	void vecToArray_2D(T**&, const vector<vector<T>>&)const;
-	// return all the same elements between two vectors
-	template<typename T>
-	vector<T> sameElem(vector<T>&, vector<T>&)const;
-
-	/*
-	* The following functions read data from txt file and prepare for Floyd or Dijkstra algorithm.
-	* The functions are before Floyd or Dijkstra algorithm.
-	*/
-
-	/*
-	* Main function: initFromTxt()
-	*/
-	// initialize data by the txt file
-	void initFromTxt()throw(valueException);
-	// set a route whether it's loop
-	void loopSetting(ifstream&, Route&)throw(valueException);
-	// set (or create) station properties, including setting which stations are in a certain route
-	void statSetting(ifstream&, Route&);
-	// set still properties like name in a station (including adding the station to a certain route)
-	int setStatStillProperties(const string&, Route&, int);
-	// set digital name in a station, in the format of "0101", "0215" just to meet the homework's requirements
-	void setDigName(Station&, string, int);
-	// set distance data between two stations, including adding the data to involved stations
-	void setStatDistance(char, double, Route&, int, int)throw(valueException);
-	// sub-function of setStatDistance, involving origDis, origPath and stat operations
-	void setDisOperation(double, Route&, int, int);
-
-	// Algorithms for computing the shortest path, including Floyd and Dijkstra.
-	void Floyd();
-	void Dijkstra(int); // the int argument represents the sequence number of source place (for Dijkstra is a single-source algorithm)
-
-	/*
-	* The following functions are after Floyd or Dijkstra algorithm.
-	*/
-
-	/*
-	* After Dijkstra or Floyd algorithm, we get the shortest distance.
-	* Now we should compute the whole path, that is, all the stations we'll pass along the shortest path.
-	*/
-	// get the shortest path between two stations by their names, including a int variable recording the length of path
-	int* searchRoute(const string&, const string&)throw(valueException);
-	// sub-function of searchRoute, execute recursion process to get the whole path
-	void routeRecur(int*, int);
-	/*
-	* After getting the whole path, now we want to compute which route to choose between two stations.
-	* Compute all available routes along the shortest path.
-	*/
-	vector<vector<string>> availableRoute(int*);
-	/*
-	* After getting all available routes, we want the "best" ones.
-	* Now I'll get the best routes from all available routes in function bestRoutSelect.
-	*/
-	vector<vector<string>> bestRoutSelect(vector<vector<string>>&);
-
-	/*
-	* Now almost everything has been done. We've got the "best routes".
-	* We just have to create an I/O interface, or we can call it an API.
-	* The following are sub-functions invoked by function userAPI().
-	*/
-	// input source place and destination place, then search and print out the best route and some more details
-	void userSearch();
-	// sub-function of userSearch(), which print out the best route
-	void printRoute(int*, int, const vector<vector<string>>&);
-	// sub-function of userSearch(), which print out details about the route
-	void printDetails(int*, int);
+	struct Worker
+	{
+		mutex lock;
+		deque<function<void()>> tasks;
+	};
+	vector<unique_ptr<Worker>> workers;
+	vector<thread> threads;
+	atomic<int> pending;         // number of tasks submitted but not taken yet
+	atomic<unsigned> nextWorker; // tasks are given to workers in turn
+	mutex sleepLock;             // idle workers sleep on wakeUp
+	condition_variable wakeUp;
+	bool stopping;
 
+	// take a task from the back of the worker's own deque, or else steal one from the front of another deque
+	// a thread outside the pool passes -1 and only steals
+	bool takeTask(int, function<void()>&);
+	// main loop of a worker thread
+	void workerLoop(int);
 public:
-	// constructors
-	Metro();
-	Metro(const Metro&);
-	Metro(Metro&&);
-	// destructors
-	~Metro();
+	WorkStealingPool(int);
+	~WorkStealingPool();
 
-	// The main API function to implement user interface.
-	void userAPI();
+	int size() const { return workers.size(); }
+	// push a task into the deque of a worker
+	void submit(function<void()>);
+	// run one pending task on the calling thread, return false if there's none
+	bool helpOnce();
+	// the pool with one worker for each core
+	static WorkStealingPool& instance();
 };
 
-// a struct to hold information about a station
-struct Metro::Station
+WorkStealingPool::WorkStealingPool(int threadNum) : pending(0), nextWorker(0), stopping(false)
 {
-	struct Node
-	{
-		string nextStat;      // from this station, which station we can directly go to (that is, adjacent stations)
-		vector<string> path;  // to go to the station mentioned above, which routes we can choose
-	};
-
-	vector<Node> next;        // as described above, it tells us information about adjacent stations
-	string name;              // name of this station
-	vector<string> digName;   // digital names of this station, like "0101"(1st station in route 1) "0213"(13th station in route 2), just to meet the requirements of homework
-	bool isTrans;             // whether it's a transfer station
+	for (int i = 0; i < threadNum; ++i)
+		workers.push_back(unique_ptr<Worker>(new Worker));
+	for (int i = 0; i < threadNum; ++i)
+		threads.push_back(thread(&WorkStealingPool::workerLoop, this, i));
+}
 
-	// useful function tools
+WorkStealingPool::~WorkStealingPool()
+{
+	{
+		lock_guard<mutex> guard(sleepLock);
+		stopping = true;
+	}
+	wakeUp.notify_all();
+	for (vector<thread>::iterator iter = threads.begin(); iter != threads.end(); ++iter)
+		(*iter).join();
+}
 
-	// add a new node to vector "next" if the added adjacent station doesn't exist, or else directly add a new path
-	void addNode(string myPath, int num, vector<Station> &stat)
+bool WorkStealingPool::takeTask(int id, function<void()> &task)
+{
+	int size = workers.size();
+	if (id >= 0)
 	{
-		bool isExisting = false;
-		string nextStat = stat[num].name;
-		for (vector<Node>::iterator iter = next.begin(); iter != next.end(); ++iter)
-			if ((*iter).nextStat == nextStat)
-			{
-				isExisting = true;
-				(*iter).path.push_back(myPath);
-				break;
-			}
-		if (!isExisting)
+		lock_guard<mutex> guard(workers[id]->lock);
+		if (!workers[id]->tasks.empty())
 		{
-			Node tempNode;
-			tempNode.nextStat = nextStat;
-			tempNode.path.push_back(myPath);
-			next.push_back(tempNode);
+			task = move(workers[id]->tasks.back());
+			workers[id]->tasks.pop_back();
+			--pending;
+			return true;
 		}
 	}
-
-	// clear the paths in a node
-	void clearNodePath(int num, vector<Station> &stat)
+	for (int i = 1; i <= size; ++i)
 	{
-		string nextStat = stat[num].name;
-		for (vector<Node>::iterator iter = next.begin(); iter != next.end(); ++iter)
-			if ((*iter).nextStat == nextStat)
-				(*iter).path.clear();
+		Worker &victim = *workers[(id + i + size) % size];
+		lock_guard<mutex> guard(victim.lock);
+		if (!victim.tasks.empty())
+		{
+			task = move(victim.tasks.front());
+			victim.tasks.pop_front();
+			--pending;
+			return true;
+		}
 	}
-};
-
-// a struct to hold information about a route
-struct Metro::Route
-{
-	string name;            // name of this route, either number or Chinese characters or something else
-	vector<string> myStat;  // which stations this route passes
-	bool isLoop;            // whether the route is loop or not
-};
-
-// search for a station whose name is matched with the passed-in argument
-int Metro::searchStatNum(const string &name)
-{
-	for (vector<Station>::iterator iter = stat.begin(); iter != stat.end(); ++iter)
-		if ((*iter).name == name)         // if the passed-in name argument is matched with a station's name
-			return iter - stat.begin();   // return its sequence number
-	return -1;                            // or else return -1 to show "not found"
+	return false;
 }
 
-// get a station's name by its sequence number
-string Metro::getStatName(int num)
+void WorkStealingPool::workerLoop(int id)
 {
-	return stat[num].name;
+	function<void()> task;
+	while (true)
+	{
+		if (takeTask(id, task))
+		{
+			task();
+			continue;
+		}
+		unique_lock<mutex> guard(sleepLock);
+		wakeUp.wait(guard, [&]() { return stopping || pending > 0; });
+		if (stopping && pending == 0)
+			return;
+	}
 }
 
-// set up a new station if the name doesn't exist
-// or else return the sequence number of the station whose name is matched with passed-in argument
-int Metro::newStation(const string &name)
+void WorkStealingPool::submit(function<void()> task)
 {
-	int whichStat = searchStatNum(name); // here function searchStatNum is invoked
-
-	// the following set up a new station if the name not found
-	if (whichStat < 0)
+	Worker &worker = *workers[nextWorker++ % workers.size()];
 	{
-		Station temp;
-		temp.name = name;
-
-		// when first set up while reading data from routes in txt, it has been passed for only once
-		// therefore it's not a transfer station
-		temp.isTrans = false;
-
-		stat.push_back(temp);
-
-		// adjust origDis and origPath for the new station
-		// include adding 1 to the side length of the two square 2D vectors and setting default values
-		newEdge<double>(origDis, INF);
-		origDis[stat.size() - 1][stat.size() - 1] = 0;
-		newEdge(origPath, -1);
-		origPath[stat.size() - 1][stat.size() - 1] = stat.size() - 1;
-
-		// the sequence number of new station
-		whichStat = stat.size() - 1;
+		lock_guard<mutex> guard(worker.lock);
+		worker.tasks.push_back(move(task));
+		++pending;
 	}
-	// if the station already exists, it's the second time visited, thus it's a transfer station
-	else stat[whichStat].isTrans = true;
-	return whichStat;
+	// lock before notifying, so that a worker going to sleep won't miss the task
+	lock_guard<mutex> guard(sleepLock);
+	wakeUp.notify_one();
 }
 
-// add 1 to the side length of a square 2D vector
-template<typename T>
-void Metro::newEdge(vector<vector<T>> &data, T value)
+bool WorkStealingPool::helpOnce()
 {
-	for (int i = 0; i < (int)data.size(); ++i)
-		data[i].push_back(value);      // the added elements have default "value"
-	vector<T> temp(data.size() + 1, value);
-	data.push_back(temp);
+	function<void()> task;
+	if (!takeTask(-1, task))
+		return false;
+	task();
+	return true;
 }
 
-// delete the k row and k col of a square 2D vector
-template<typename T>
-void Metro::delEdge(vector<vector<T>> &data, int k)throw(valueException)
+WorkStealingPool& WorkStealingPool::instance()
 {
-	try
-	{
-		int n = data.size();
-		if (k < 0 || k >= n) throw valueException(k);
-		// delete single elements of k col
-		for (int i = n - 1; i > k; --i)
-			data[i].erase(data[i].begin() + k);
-		// delete k row
-		data.erase(data.begin() + k);
-		// delete single elements of k col
-		for (int i = k - 1; i >= 0; --i)
-			data[i].erase(data[i].begin() + k);
-	}
-	catch (valueException &ex) { cout << ex.what(); ex.printValue(); cout << endl; }
+	static WorkStealingPool pool(max(1, (int)thread::hardware_concurrency()));
+	return pool;
 }
 
-int Metro::calTxtLine(ifstream &file)const
+// a whole file mapped into memory
+// pages are private to the process: they may be written, but the changes are never written back to the file
+class MappedFile
 {
-	// renew file state and put file pointer to the beginning of txt
-	file.clear();
-	file.seekg(0, ios::beg);
+private:
+	char *base;
+	size_t len;
+#ifdef _WIN32
+	HANDLE mapping;
+#endif
+public:
+	MappedFile() : base(nullptr), len(0) {}
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	~MappedFile() { close(); }
 
-	int lineNum = 0;
+	// map a file, return false if failed
+	bool open(const string&);
+	void close();
+	char* data() const { return base; }
+	size_t size() const { return len; }
+};
 
-	while (!file.eof())
+bool MappedFile::open(const string &src)
+{
+	close();
+#ifdef _WIN32
+	HANDLE file = CreateFileA(src.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER fileSize;
+	GetFileSizeEx(file, &fileSize);
+	len = (size_t)fileSize.QuadPart;
+	mapping = len == 0 ? nullptr : CreateFileMappingA(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+	CloseHandle(file);
+	if (len == 0)
+		return true;
+	if (mapping == nullptr)
+		return false;
+	base = (char*)MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+	if (base == nullptr)
 	{
-		char temp[1024];          // a temp char array, just to contain the data, no significance
-		file.getline(temp, 1024); // getline stop at '\n', thus we used it to calculate lines
-		if (temp[0] != 0)         // ignore empty lines
-			++lineNum;
+		CloseHandle(mapping);
+		return false;
 	}
-
-	// renew file state and put file pointer to the beginning of txt
-	file.clear();
-	file.seekg(0, ios::beg);
-
-	return lineNum;
+#else
+	int file = ::open(src.c_str(), O_RDONLY);
+	if (file < 0)
+		return false;
+	struct stat fileStat;
+	if (fstat(file, &fileStat) < 0)
+	{
+		::close(file);
+		return false;
+	}
+	len = fileStat.st_size;
+	if (len > 0)
+	{
+		void *addr = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0);
+		base = addr == MAP_FAILED ? nullptr : (char*)addr;
+	}
+	::close(file);
+	if (len > 0 && base == nullptr)
+		return false;
+#endif
+	return true;
 }
 
-// here the ptr is passed in by reference
-template<typename T>
-void Metro::vecToArray_2D(T**& ptr, const vector<vector<T>>& vec)const
+void MappedFile::close()
 {
-	int n = vec.size();
-	ptr = new T*[n];
-	for (int i = 0; i < n; ++i)
+	if (base != nullptr)
 	{
-		ptr[i] = new T[n];
-		for (int j = 0; j < n; ++j)
-			ptr[i][j] = vec[i][j];  // copy elements from vector to array
+#ifdef _WIN32
+		UnmapViewOfFile(base);
+		CloseHandle(mapping);
+#else
+		munmap(base, len);
+#endif
 	}
+	base = nullptr;
+	len = 0;
 }
 
-// return same elements between vector a and vector b
-template<typename T>
-vector<T> Metro::sameElem(vector<T> &vec1, vector<T> &vec2)const
+// a piece of text inside a buffer owned by someone else, thus nothing is copied
+struct TextView
 {
-	vector<T> res;
-	for (vector<T>::iterator iter1 = vec1.begin(); iter1 != vec1.end(); ++iter1)
-		for (vector<T>::iterator iter2 = vec2.begin(); iter2 != vec2.end(); ++iter2)
-			if (*iter1 == *iter2)
-			{
-				res.push_back(*iter1);
-				break;
-			}
-	return res;
-}
+	const char *str;
+	int len;
+};
 
-void Metro::initFromTxt()throw(valueException)
+// seconds after midnight of a time like "h:mm" or "hh:mm", hours after 23 are for the next day, -1 if it's wrong
+static int clockSeconds(const char *str, int len)
 {
-	ifstream file(fileSrc);
-	if (!file)
-	{
-		cout << "Invalid file directory!" << endl;
-		throw valueException("File Open Failed");
-	}
-	int lineNum = calTxtLine(file);
-
-	// read data in each line in txt
-	for (int i = 0; i < lineNum; ++i)
-	{
-		// record route number
-		Route routTemp;
-		file >> routTemp.name;
-		// set whether loop
-		loopSetting(file, routTemp);
-		// begin to read stations, distances and directions
-		statSetting(file, routTemp);
-	}
-	file.close();
-	// copy the original vector to array to prepare for Floyd or Dijkstra algorithm
-	vecToArray_2D(leastDis, origDis);
-	vecToArray_2D(path, origPath);
+	int hour = 0, i = 0;
+	for (; i < len && i < 3 && str[i] >= '0' && str[i] <= '9'; ++i)
+		hour = hour * 10 + (str[i] - '0');
+	if (i == 0 || i > 2 || i + 3 != len || str[i] != ':' || str[i + 1] < '0' || str[i + 1] > '5' || str[i + 2] < '0' || str[i + 2] > '9')
+		return -1;
+	return (hour * 60 + (str[i + 1] - '0') * 10 + (str[i + 2] - '0')) * 60;
 }
 
-// set whether a route is loop
-void Metro::loopSetting(ifstream &file, Route &temp)throw(valueException)
+// a time of "h:mm" from seconds after midnight, seconds are dropped
+static string clockText(int seconds)
 {
-	char isLoop;
-	try
-	{
-		file >> isLoop;
-		if (isLoop == 'y')
-			temp.isLoop = true;
-		else if (isLoop == 'n')
-			temp.isLoop = false;
-		else
-			throw valueException(isLoop);
-	}
-	catch (valueException &ex) { cout << ex.what(); ex.printValue(); cout << endl; }
+	ostringstream out;
+	out << seconds / 3600 << ':' << setw(2) << setfill('0') << seconds / 60 % 60;
+	return out.str();
 }
 
-void Metro::statSetting(ifstream &file, Route &temp)
+// splits a txt file into tokens line by line, spaces, tabs and '\r' separate tokens
+// errors are reported with the line and the column (counted by bytes) where they're found
+class TxtScanner
 {
-	// isLineEnd is used to record '\n', the end of a line in txt
-	// direc means direction
-	char isLineEnd, direc;
-	// counter records the sequence number of each station in a route, like 1 means the 1st station (departure) in a route
-	// preNum and sufNum records sequence number of two adjacent stations, preNum is the former one, and sufNum is the latter
-	int counter = 1, preNum, sufNum;
-	// distance between two adjacent stations
-	double distance;
-	// like preNum and sufNum, preName and sufName mean the names of two adjacent stations
-	string preName, sufName;
-
-	// initialization of the first station in a route
-	file >> preName;
-	preNum = setStatStillProperties(preName, temp, counter);
+private:
+	const char *cur, *end;
+	const char *lineBegin;  // where the current line begins, used to compute the column
+	int line;
 
-	file.get(isLineEnd);
-	// when the file and the line doesn't end
-	while (!file.eof() && isLineEnd != '\n')
-	{
-		file >> distance >> direc >> sufName; // read data
-		++counter; // since it's the next station, counter adds 1
+	static bool isSpace(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+	void skipSpaces() { while (cur < end && isSpace(*cur)) ++cur; }
+public:
+	TxtScanner(const char *data, size_t size) : cur(data), end(data + size), lineBegin(data), line(1) {}
 
-		// set station and route information
-		sufNum = setStatStillProperties(sufName, temp, counter);
-		setStatDistance(direc, distance, temp, preNum, sufNum);
+	// skip empty lines, return false at the end of file
+	bool nextLine();
+	// whether nothing but spaces is left in the current line, and then move to the next line
+	bool lineEnd();
+	// the next token in the current line
+	TextView token(const char*)throw(valueException);
+	// the next token as a non-negative decimal number
+	double number(const char*)throw(valueException);
+	// the next token as a single char which must be one of the allowed chars
+	char flag(const char*, const char*)throw(valueException);
+	// the next token as a time of "h:mm", in seconds after midnight, hours after 23 are for trains after midnight
+	int clock(const char*)throw(valueException);
+	// print where the error is, then throw
+	void fail(const string&)const throw(valueException);
+};
 
-		// the latter station will become the former one
-		preNum = sufNum;
-		file.get(isLineEnd);
+bool TxtScanner::nextLine()
+{
+	for (;;)
+	{
+		skipSpaces();
+		if (cur == end)
+			return false;
+		if (*cur != '\n')
+			return true;
+		lineBegin = ++cur;
+		++line;
 	}
 }
 
-// mainly set station information, including adding it to the route
-int Metro::setStatStillProperties(const string &name, Route &temp, int counter)
+bool TxtScanner::lineEnd()
 {
-	// if existing, then return the sequence number, or else create a new one then return its number
-	int num = newStation(name);
-	// add it to the route
-	temp.myStat.push_back(name);
-	// set digital names in the station, like "0101" "0213", as required in the homework
-	setDigName(stat[num], temp.name, counter);
-
-	return num;
+	skipSpaces();
+	if (cur == end)
+		return true;
+	if (*cur != '\n')
+		return false;
+	lineBegin = ++cur;
+	++line;
+	return true;
 }
 
-void Metro::setDigName(Station &myStat, string routName, int counter)
+TextView TxtScanner::token(const char *what)throw(valueException)
 {
-	// use the counter and the route name
-	char digName[3] = { 0 };
-	if (routName.size() == 1)
-		routName.insert(0, "0");
-	digName[0] = counter / 10 + '0';
-	digName[1] = counter % 10 + '0';
-	routName += digName;
-	myStat.digName.push_back(routName);
+	skipSpaces();
+	if (cur == end || *cur == '\n')
+		fail(string("missing ") + what);
+	TextView view = { cur, 0 };
+	while (cur < end && !isSpace(*cur) && *cur != '\n')
+		++cur;
+	view.len = cur - view.str;
+	return view;
 }
 
-// mainly set distance data between 2 stations
-void Metro::setStatDistance(char direc, double distance, Route &temp, int preNum, int sufNum)throw(valueException)
+double TxtScanner::number(const char *what)throw(valueException)
 {
-	try
+	TextView view = token(what);
+	double value = 0, scale = 1;
+	bool point = false;
+	for (int i = 0; i < view.len; ++i)
 	{
-		// decide according to the route diretion between 2 stations
-		switch (direc)
+		char c = view.str[i];
+		if (c == '.' && !point)
+			point = true;
+		else if (c >= '0' && c <= '9')
 		{
-		// 'b'(both) means both directions are ok, 'u'(up) means from former to latter, 'd'(down) means from latter to former
-		case'b': setDisOperation(distance, temp, preNum, sufNum); setDisOperation(distance, temp, sufNum, preNum); break;
-		case'u': setDisOperation(distance, temp, preNum, sufNum); break;
-		case'd': setDisOperation(distance, temp, sufNum, preNum); break;
-		default: throw valueException(direc);
+			if (point)
+				value += (c - '0') * (scale /= 10);
+			else
+				value = value * 10 + (c - '0');
+		}
+		else
+		{
+			cur = view.str + i;
+			fail(string("wrong ") + what);
 		}
 	}
-	catch (valueException &ex) { cout << ex.what(); ex.printValue(); cout << endl; }
+	return value;
 }
 
-// detailed operation process
-void Metro::setDisOperation(double distance, Route &temp, int preNum, int sufNum)
+char TxtScanner::flag(const char *what, const char *allowed)throw(valueException)
 {
-	// if never set distance data between the 2 stations
-	if (origPath[preNum][sufNum] < 0)
+	TextView view = token(what);
+	if (view.len != 1 || strchr(allowed, view.str[0]) == nullptr)
 	{
-		origDis[preNum][sufNum] = distance;
-		origPath[preNum][sufNum] = preNum;
-		stat[preNum].addNode(temp.name, sufNum, stat); // add data to relevant station
+		cur = view.str;
+		fail(string("wrong ") + what);
 	}
+	return view.str[0];
+}
 
-	// if have already set the data once, twice or more times
-	// when distance is shorter than former ones
-	else if (distance < origDis[preNum][sufNum])
+int TxtScanner::clock(const char *what)throw(valueException)
+{
+	TextView view = token(what);
+	int seconds = clockSeconds(view.str, view.len);
+	if (seconds < 0)
 	{
-		stat[preNum].clearNodePath(sufNum, stat); // clear path data of the station
-		origDis[preNum][sufNum] = distance;       // reset distance
-		stat[preNum].addNode(temp.name, sufNum, stat);
+		cur = view.str;
+		fail(string("wrong ") + what);
 	}
-	else if (distance == origDis[preNum][sufNum])
-		stat[preNum].addNode(temp.name, sufNum, stat); // just add data to the station
+	return seconds;
 }
 
-// Floyd algorithm to calculate the shortest path from all stations to all stations
-// time cost is O(n^3)
-void Metro::Floyd()
+void TxtScanner::fail(const string &message)const throw(valueException)
 {
-	int size = stat.size();
-	for (int k = 0; k < size; ++k)
-		for (int i = 0; i < size; ++i)
-			for (int j = 0; j < size; ++j)
-				if (leastDis[i][j] > leastDis[i][k] + leastDis[k][j])
-				{
-					leastDis[i][j] = leastDis[i][k] + leastDis[k][j];
-					path[i][j] = k;
-				}
+	cout << "Wrong format at line " << line << ", column " << cur - lineBegin + 1 << ": " << message << endl;
+	throw valueException(message);
 }
 
-// Dijkstra algorithm to calculate the shortest path from one station to all stations
-// n means the sequence number of the departure station
-void Metro::Dijkstra(int n)
+// interning table of names, it gives every different name a dense sequence number starting from 0
+// names are stored one after another in a char pool, and found by an open addressing hash table
+class NameTable
 {
-	// here an unordered set is used
-	unordered_set<int> des;
-	// insert destinations to the unordered set
-	for (int i = 0; i < (int)stat.size(); ++i)
-		if (i != n)des.insert(i);
+private:
+	vector<char> pool;  // all names one after another
+	vector<int> start;  // name i is from pool[start[i]] to pool[start[i + 1] - 1]
+	vector<int> slot;   // hash table of sequence numbers, -1 means empty, its size is always a power of 2
 
-	while (des.size() > 0)
-	{
-		// find the minimum distance by traversing the unordered set
-		double min = leastDis[n][*des.begin()];              // minimum distance
-		unordered_set<int>::iterator min_iter = des.begin(); // iterator of the element which has the minimum distance
-		for (unordered_set<int>::iterator iter = des.begin(); iter != des.end(); ++iter)
-		{
-			if (leastDis[n][*iter] < min)
-			{
-				min = leastDis[n][*iter];
-				min_iter = iter;
-			}
-		}
+	// FNV-1a hash of a name
+	static unsigned hashName(const char*, int);
+	// the slot where a name is, or the empty slot where it should be inserted
+	int findSlot(const char*, int)const;
+public:
+	NameTable() : start(1, 0), slot(16, -1) {}
 
-		int min_sub = *min_iter; // min_sub records the subscript of the element which has the minimum distance
+	int size() const { return (int)start.size() - 1; }
+	// return the sequence number of a name, or -1 if not found
+	int find(const char *name, int len) const { return slot[findSlot(name, len)]; }
+	int find(const string &name) const { return find(name.data(), name.size()); }
+	// return the sequence number of a name, and add the name first if not found
+	int intern(const char*, int);
+	int intern(const string &name) { return intern(name.data(), name.size()); }
+	// get a name by its sequence number
+	string name(int i) const { return string(pool.data() + start[i], start[i + 1] - start[i]); }
+};
 
-		// remove the element from unordered set
-		des.erase(min_iter);
+unsigned NameTable::hashName(const char *name, int len)
+{
+	unsigned hash = 2166136261u;
+	for (int i = 0; i < len; ++i)
+		hash = (hash ^ (unsigned char)name[i]) * 16777619u;
+	return hash;
+}
 
-		// update distance data of remaining elements in unordered set
-		for (unordered_set<int>::iterator iter = des.begin(); iter != des.end(); ++iter)
-		{
-			if (min + leastDis[min_sub][*iter] < leastDis[n][*iter])
-			{
-				leastDis[n][*iter] = min + leastDis[min_sub][*iter];
-				path[n][*iter] = min_sub;
-			}
-		}
+int NameTable::findSlot(const char *name, int len)const
+{
+	int mask = slot.size() - 1;
+	for (int i = hashName(name, len) & mask; ; i = (i + 1) & mask)
+	{
+		int num = slot[i];
+		if (num < 0 || (start[num + 1] - start[num] == len && equal(name, name + len, pool.begin() + start[num])))
+			return i;
 	}
 }
 
-// get the complete route (all the passed stations) along the shortest path
-int* Metro::searchRoute(const string &src, const string &des)throw(valueException)
+int NameTable::intern(const char *name, int len)
 {
-	int srcNum, desNum; // sequence number of the source station and destination station
-	try
+	int i = findSlot(name, len);
+	if (slot[i] >= 0)
+		return slot[i];
+
+	slot[i] = size();
+	pool.insert(pool.end(), name, name + len);
+	start.push_back(pool.size());
+
+	// keep the load factor under 1/2, thus empty slots are always found quickly
+	if (size() * 2 > (int)slot.size())
 	{
-		// get number by station's name
-		srcNum = searchStatNum(src);
-		desNum = searchStatNum(des);
+		slot.assign(slot.size() * 2, -1);
+		for (int num = 0; num < size(); ++num)
+			slot[findSlot(pool.data() + start[num], start[num + 1] - start[num])] = num;
+	}
+	return size() - 1;
+}
 
-		// exception processing
-		if (srcNum < 0)
-			throw valueException(srcNum);
-		else if (desNum < 0)
-			throw valueException(desNum);
-		else if (leastDis[srcNum][desNum] == INF)
+// a set of lines stored as a bitset, the i-th bit is the line whose sequence number is i
+struct LineSet
+{
+	unsigned long long word[MAX_LINE_NUM / 64];
+
+	LineSet() { clear(); }
+	void clear() { fill(word, word + MAX_LINE_NUM / 64, 0ULL); }
+	void set(int i) { word[i >> 6] |= 1ULL << (i & 63); }
+	bool test(int i) const { return (word[i >> 6] >> (i & 63) & 1) != 0; }
+	bool none() const
+	{
+		for (int w = 0; w < MAX_LINE_NUM / 64; ++w)
+			if (word[w] != 0)
+				return false;
+		return true;
+	}
+	// the first line in the set whose number is not less than i, or -1 if there's none
+	int next(int i) const
+	{
+		for (; i < MAX_LINE_NUM; ++i)
 		{
-			cout << "Can't arrive!" << endl;
-			throw valueException(INF);
+			if ((word[i >> 6] >> (i & 63)) == 0)
+				i |= 63;  // skip the rest of an empty word
+			else if (test(i))
+				return i;
+		}
+		return -1;
+	}
+	LineSet operator&(const LineSet &a) const
+	{
+		LineSet res;
+		for (int w = 0; w < MAX_LINE_NUM / 64; ++w)
+			res.word[w] = word[w] & a.word[w];
+		return res;
+	}
+	bool operator==(const LineSet &a) const { return equal(word, word + MAX_LINE_NUM / 64, a.word); }
+	bool operator!=(const LineSet &a) const { return !(*this == a); }
+};
+
+// write a string in JSON, quoted and escaped
+static void writeJson(ostream &out, const string &str)
+{
+	out << '"';
+	for (string::const_iterator iter = str.begin(); iter != str.end(); ++iter)
+	{
+		unsigned char c = *iter;
+		if (c == '"' || c == '\\')
+			out << '\\' << c;
+		else if (c < 0x20)
+		{
+			const char *hex = "0123456789abcdef";
+			out << "\\u00" << hex[c >> 4] << hex[c & 15];
 		}
+		else
+			out << c;
+	}
+	out << '"';
+}
+
+/*
+* Counters of an engine, updated by all the threads searching on it without locks.
+* Phases are timed by PhaseTimer, and "reconstruct" (walking back along a route) is a part of "search".
+* Counters of a query are kept in its scratch memory while searching, and added here once when the query ends,
+* thus the inner loops of searches never touch shared memory.
+*/
+class MetroMetrics
+{
+public:
+	enum Phase { LOAD, TABLES, HIERARCHY, SKELETON, STATE_GRAPH, REPAIR, SEARCH, RECONSTRUCT, LINES, PHASE_NUM };
+	enum Counter { QUERIES, FAILED, SETTLED, RELAXED, ROUTE_STATIONS, CACHE_HITS, CACHE_MISSES, ALLOCATIONS, COUNTER_NUM };
+	// upper bounds of latency buckets by seconds, from 1us and multiplied by 4, the last bucket has no bound
+	static const int BUCKET_NUM = 11;
 
-		// init is to store all passed stations
-		int *init = new int[MAX_ROUTE_LEN];
-		// at beginning we only have source station and destination station
-		init[0] = srcNum, init[1] = desNum, init_len = 2;
-		// compute by recursion
-		routeRecur(init, 0);
+	class PhaseTimer
+	{
+	private:
+		MetroMetrics &metrics;
+		Phase phase;
+		chrono::steady_clock::time_point begin;
+	public:
+		PhaseTimer(MetroMetrics &m, Phase p) : metrics(m), phase(p), begin(chrono::steady_clock::now()) {}
+		~PhaseTimer() { metrics.addPhase(phase, chrono::steady_clock::now() - begin); }
+	};
 
-		return init;
+	MetroMetrics() { clear(); }
+	MetroMetrics(const MetroMetrics&);
+	void clear();
+	void addPhase(Phase phase, chrono::steady_clock::duration time)
+	{
+		phaseNs[phase].fetch_add(chrono::duration_cast<chrono::nanoseconds>(time).count(), memory_order_relaxed);
+		phaseCalls[phase].fetch_add(1, memory_order_relaxed);
+	}
+	void add(Counter counter, long long n) { counters[counter].fetch_add(n, memory_order_relaxed); }
+	// for counters kept by their owners, such as the hits of tree caches
+	void set(Counter counter, long long n) { counters[counter].store(n, memory_order_relaxed); }
+	// latency of a whole query
+	void addLatency(chrono::steady_clock::duration);
+
+	// {"phases":{"load":{"calls":1,"seconds":0.01},...},"counters":{"queries":0,...},"latency":{"buckets":[...],"sum":0,"count":0}}
+	void writeJson(ostream&)const;
+	// Prometheus text exposition of the engines of many cities, each sample labeled by its city
+	static void writePrometheus(ostream&, const vector<pair<string, const MetroMetrics*>>&);
+private:
+	atomic<long long> phaseNs[PHASE_NUM], phaseCalls[PHASE_NUM], counters[COUNTER_NUM];
+	atomic<long long> buckets[BUCKET_NUM], latencyNs;
+
+	static const char *phaseNames[PHASE_NUM];
+	static const char *counterNames[COUNTER_NUM];
+	static const char *counterHelps[COUNTER_NUM];
+	static double bucketBound(int i) { return 1e-6 * pow(4.0, i); }
+	// a label value of the text exposition, where backslashes, double quotes and line feeds are escaped
+	static string labelValue(const string&);
+};
+
+const char *MetroMetrics::phaseNames[PHASE_NUM] = { "load", "tables", "hierarchy", "skeleton", "state_graph", "repair", "search", "reconstruct", "lines" };
+const char *MetroMetrics::counterNames[COUNTER_NUM] = {
+	"queries", "failed_queries", "settled_stations", "relaxed_edges", "route_stations", "tree_cache_hits", "tree_cache_misses", "allocations"
+};
+const char *MetroMetrics::counterHelps[COUNTER_NUM] = {
+	"Queries searched.", "Queries without any route.", "Stations (or states) settled by searches.", "Edges scanned by searches.",
+	"Stations along routes found.", "Shortest path trees found in the cache.", "Shortest path trees computed for the cache.",
+	"Scratch memory, trees and tables allocated."
+};
+
+MetroMetrics::MetroMetrics(const MetroMetrics &a)
+{
+	for (int i = 0; i < PHASE_NUM; ++i)
+	{
+		phaseNs[i] = a.phaseNs[i].load();
+		phaseCalls[i] = a.phaseCalls[i].load();
+	}
+	for (int i = 0; i < COUNTER_NUM; ++i)
+		counters[i] = a.counters[i].load();
+	for (int i = 0; i < BUCKET_NUM; ++i)
+		buckets[i] = a.buckets[i].load();
+	latencyNs = a.latencyNs.load();
+}
+
+void MetroMetrics::clear()
+{
+	for (int i = 0; i < PHASE_NUM; ++i)
+		phaseNs[i] = phaseCalls[i] = 0;
+	for (int i = 0; i < COUNTER_NUM; ++i)
+		counters[i] = 0;
+	for (int i = 0; i < BUCKET_NUM; ++i)
+		buckets[i] = 0;
+	latencyNs = 0;
+}
+
+void MetroMetrics::addLatency(chrono::steady_clock::duration time)
+{
+	long long ns = chrono::duration_cast<chrono::nanoseconds>(time).count();
+	int i = 0;
+	while (i < BUCKET_NUM - 1 && ns * 1e-9 > bucketBound(i))
+		++i;
+	buckets[i].fetch_add(1, memory_order_relaxed);
+	latencyNs.fetch_add(ns, memory_order_relaxed);
+}
+
+void MetroMetrics::writeJson(ostream &out)const
+{
+	out << "{\"phases\":{";
+	for (int i = 0; i < PHASE_NUM; ++i)
+		out << (i > 0 ? "," : "") << '"' << phaseNames[i] << "\":{\"calls\":" << phaseCalls[i] << ",\"seconds\":" << phaseNs[i] * 1e-9 << '}';
+	out << "},\"counters\":{";
+	for (int i = 0; i < COUNTER_NUM; ++i)
+		out << (i > 0 ? "," : "") << '"' << counterNames[i] << "\":" << counters[i];
+	out << "},\"latency\":{\"buckets\":[";
+	long long count = 0;
+	for (int i = 0; i < BUCKET_NUM; ++i)
+	{
+		count += buckets[i];
+		out << (i > 0 ? "," : "") << "{\"le\":";
+		if (i < BUCKET_NUM - 1)
+			out << bucketBound(i);
+		else
+			out << "null";
+		out << ",\"count\":" << count << '}';
+	}
+	out << "],\"sum\":" << latencyNs * 1e-9 << ",\"count\":" << count << "}}";
+}
+
+string MetroMetrics::labelValue(const string &str)
+{
+	string res;
+	for (string::const_iterator iter = str.begin(); iter != str.end(); ++iter)
+		if (*iter == '\\' || *iter == '"')
+			res.append(1, '\\').append(1, *iter);
+		else if (*iter == '\n')
+			res += "\\n";
+		else
+			res += *iter;
+	return res;
+}
+
+void MetroMetrics::writePrometheus(ostream &out, const vector<pair<string, const MetroMetrics*>> &cities)
+{
+	typedef vector<pair<string, const MetroMetrics*>>::const_iterator Iter;
+	out << "# HELP metro_phase_seconds_total Time spent in each phase, reconstruct is a part of search.\n"
+		<< "# TYPE metro_phase_seconds_total counter\n";
+	for (Iter iter = cities.begin(); iter != cities.end(); ++iter)
+		for (int i = 0; i < PHASE_NUM; ++i)
+			out << "metro_phase_seconds_total{city=\"" << labelValue(iter->first) << "\",phase=\"" << phaseNames[i] << "\"} " << iter->second->phaseNs[i] * 1e-9 << '\n';
+	out << "# HELP metro_phase_calls_total Times each phase ran.\n"
+		<< "# TYPE metro_phase_calls_total counter\n";
+	for (Iter iter = cities.begin(); iter != cities.end(); ++iter)
+		for (int i = 0; i < PHASE_NUM; ++i)
+			out << "metro_phase_calls_total{city=\"" << labelValue(iter->first) << "\",phase=\"" << phaseNames[i] << "\"} " << iter->second->phaseCalls[i] << '\n';
+	for (int i = 0; i < COUNTER_NUM; ++i)
+	{
+		out << "# HELP metro_" << counterNames[i] << "_total " << counterHelps[i] << '\n'
+			<< "# TYPE metro_" << counterNames[i] << "_total counter\n";
+		for (Iter iter = cities.begin(); iter != cities.end(); ++iter)
+			out << "metro_" << counterNames[i] << "_total{city=\"" << labelValue(iter->first) << "\"} " << iter->second->counters[i] << '\n';
+	}
+	out << "# HELP metro_query_seconds Latency of queries.\n"
+		<< "# TYPE metro_query_seconds histogram\n";
+	for (Iter iter = cities.begin(); iter != cities.end(); ++iter)
+	{
+		long long count = 0;
+		for (int i = 0; i < BUCKET_NUM; ++i)
+		{
+			count += iter->second->buckets[i];
+			out << "metro_query_seconds_bucket{city=\"" << labelValue(iter->first) << "\",le=\"";
+			if (i < BUCKET_NUM - 1)
+				out << bucketBound(i);
+			else
+				out << "+Inf";
+			out << "\"} " << count << '\n';
+		}
+		out << "metro_query_seconds_sum{city=\"" << labelValue(iter->first) << "\"} " << iter->second->latencyNs * 1e-9 << '\n'
+			<< "metro_query_seconds_count{city=\"" << labelValue(iter->first) << "\"} " << count << '\n';
 	}
-	catch (valueException &ex) { cout << ex.what(); ex.printValue(); cout << endl; }
-	return nullptr;
 }
 
-void Metro::routeRecur(int *init, int k) // init is to store the result, and we insert after init[k]
+// main class
+class Metro
 {
+private:
+	// declare 2 basic structures to store data about station/route
+	struct Station;
+	struct Route;
+	// file position of metro data
+	string fileSrc;
+	// algorithm chosen, d - Dijkstra, f - Floyd, p - parallel Dijkstra for all pairs, l - line-aware Dijkstra,
+	// b - bidirectional Dijkstra, c - contraction hierarchies, s - skeleton of transfer stations
+	char alg;
+
+	/*
+	* Compressed sparse row (CSR) form of the metro network, built after reading the txt file.
+	* A station has only a few adjacent stations, so we store edges rather than a square 2D vector,
+	* and memory scales with the number of edges instead of the square of the number of stations.
+	*/
+	struct Graph
+	{
+		vector<int> offset;     // edges leaving station i are numbered from offset[i] to offset[i + 1] - 1, size is (stations + 1)
+		vector<int> target;     // target[e] is the station edge e goes to
+		vector<double> weight;  // weight[e] is the distance of edge e
+		vector<LineSet> lines;  // lines[e] is the set of lines we can choose on edge e
+
+		// number of stations
+		int size() const { return (int)offset.size() - 1; }
+		// return the number of edge from station "from" to station "to", or -1 if they're not adjacent
+		int findEdge(int from, int to) const
+		{
+			for (int e = offset[from]; e < offset[from + 1]; ++e)
+				if (target[e] == to)
+					return e;
+			return -1;
+		}
+	};
+
+	/*
+	* Contraction hierarchies. Stations are contracted one by one, and when a station is contracted,
+	* a shortcut is added between two of its neighbours unless a path without it (a witness) is no longer.
+	* A query only goes from lower ranked stations to higher ranked ones, in both directions, thus it settles very few stations.
+	*/
+	struct HierarchyEdge
+	{
+		int from, to;
+		double weight;
+		int first, second;  // the two edges a shortcut is made of (from -> middle, middle -> to), -1 for an original edge
+	};
+	struct Hierarchy
+	{
+		vector<int> rank;             // order in which each station is contracted, empty if the hierarchy isn't built
+		vector<HierarchyEdge> edges;  // original edges and shortcuts, children of a shortcut always come before it
+		vector<int> upOff, up;        // edges leaving station i to higher ranked stations are up[upOff[i]] ... up[upOff[i + 1] - 1]
+		vector<int> downOff, down;    // edges entering station i from higher ranked stations, in the same way
+
+		bool empty() const { return rank.empty(); }
+	};
+	// it never changes once built, and copies share it, nullptr if it isn't built
+	shared_ptr<const Hierarchy> hierarchy;
+
+	/*
+	* Skeleton of transfer stations. A chain station has exactly two neighbours and isn't a transfer station,
+	* all the others (transfer stations, termini and branches) are skeleton stations.
+	* Chain stations between two skeleton stations form a chain, and all-pairs tables are kept only between skeleton stations,
+	* while a chain station only keeps its position and the prefix distances along its chain.
+	* A distance is at most two chain offsets plus one table lookup, and there're at most four such combinations.
+	*/
+	struct Skeleton
+	{
+		vector<int> num;           // sequence number in the skeleton of each station, -1 for chain stations
+		vector<int> stat;          // station of each skeleton station
+		vector<int> chainOf;       // chain of each chain station, -1 for skeleton stations
+		vector<int> chainPos;      // position of each chain station in chainStat
+		// stations of chain c are chainStat[chainOff[c]] ... chainStat[chainOff[c + 1] - 1], including the skeleton stations at both ends
+		vector<int> chainOff, chainStat;
+		// prefix distances along a chain in both directions, and prefix numbers of one-way sections which can't be passed
+		vector<double> fwd, bwd;
+		vector<int> fwdBroken, bwdBroken;
+		Graph graph;               // skeleton stations and the chains between them, lines of edges aren't used
+		vector<int> edgeChain;     // 2 * chain + 1 when an edge goes along a chain backwards, 2 * chain forwards, -1 for an original edge
+		vector<double> dis;        // shortest distances between skeleton stations (size * size)
+		vector<int> prev;          // previous skeleton station along the shortest path, -1 if there's none
+
+		int size() const { return stat.size(); }
+	};
+	// shared in the same way as the hierarchy
+	shared_ptr<const Skeleton> skeleton;
+	// where a route leaves or enters the skeleton from a station
+	struct SkeletonEnd
+	{
+		int pos;    // position of the station in skeleton.chainStat, -1 if the station is a skeleton station
+		int end;    // position of the skeleton station at the end of the chain, -1 as above
+		int num;    // sequence number of the skeleton station in the skeleton
+		double dis; // distance along the chain
+	};
+
+	// a 4-ary min-heap of (distance, station) pairs used by the heap-based Dijkstra engine
+	// a station may be pushed several times, outdated pairs are skipped when they are popped
+	struct MinHeap
+	{
+		struct Elem
+		{
+			double key;  // tentative distance
+			int num;     // sequence number of the station
+		};
+		vector<Elem> data;
+
+		bool empty() const { return data.empty(); }
+		void clear() { data.clear(); }
+		const Elem& top() const { return data[0]; }
+		void push(double key, int num);
+		void pop();
+	};
+
+	/*
+	* Scratch memory of a single query, so that a query never writes into data shared by other queries.
+	* Entries are valid only when their stamp equals curStamp, thus nothing has to be cleared between queries.
+	*/
+	struct QueryScratch
+	{
+		vector<double> dis;      // tentative distance from the source station
+		vector<int> prev;        // previous station along the shortest path, -1 for the source station
+		vector<unsigned> stamp;  // which query the entries above belong to
+		unsigned curStamp = 0;
+		MinHeap heap;
+		vector<int> route;       // stations along the route found by the query
+		vector<LineSet> lines;   // lines of each section along the route
+		bool quiet = false;      // failures aren't reported on the console, for queries by API
+		// counters of the query, added to MetroMetrics when it ends
+		long long settled = 0, relaxed = 0, allocations = 0;
+		// the backward search of bidirectional Dijkstra, from the destination station
+		vector<double> backDis;  // tentative distance to the destination station
+		vector<int> next;        // next station along the shortest path, -1 for the destination station
+		vector<unsigned> backStamp;
+		MinHeap backHeap;
+		// labels of RAPTOR, the label of station i after round k is at k * n + i
+		vector<double> roundDis;
+		vector<int> roundBoard, roundAlight;  // stops where the ride of round k to station i boards and alights, -1 if kept from round k - 1
+		vector<int> marked;                   // stations improved in the last round
+		vector<char> isMarked;
+		vector<int> patternFrom;              // first marked stop of each pattern, -1 if the pattern isn't queued
+		vector<int> queued;                   // patterns to scan in this round
+
+		// prepare for a new query on a graph of n stations
+		void reset(int n);
+		// prepare the backward search as well
+		void resetBoth(int n);
+		double getDis(int i) const { return stamp[i] == curStamp ? dis[i] : INF; }
+		void setDis(int i, double d, int p) { dis[i] = d; prev[i] = p; stamp[i] = curStamp; }
+		double getBackDis(int i) const { return backStamp[i] == curStamp ? backDis[i] : INF; }
+		void setBackDis(int i, double d, int p) { backDis[i] = d; next[i] = p; backStamp[i] = curStamp; }
+	};
+	// scratch memory used by userSearch
+	QueryScratch userScratch;
+
+	double transferPenalty;  // transfer penalty used by userSearch
+
+	/*
+	* Timetables expanded into connections for the Connection Scan engine, a connection is a train leaving a station
+	* and arriving at the next one. They're sorted by departure in one flat array, thus an earliest-arrival query scans
+	* a contiguous part of it once, from the departure time on, and stops at the arrival at the destination.
+	*/
+	struct Connection
+	{
+		int departure, arrival;  // seconds after midnight of the service day
+		int from, to;
+		int edge;                // edge of the graph from from to to, the connection is closed with it
+		int line;
+	};
+
+	/*
+	* Everything read from the txt file (or a snapshot) and built from it before queries: stations, routes, graphs and patterns.
+	* A network never changes once built, and a Metro only points to it, thus copying or moving a Metro takes a reference
+	* rather than copying the network. Closures and distances changed later are kept in Changes, the network keeps those
+	* read from the file. Only the tables and the indexes of the engine are kept out of it, since changes repair or drop them.
+	*/
+	struct Network
+	{
+		// 2 vectors to store station and route data
+		vector<Station> stat;
+		vector<Route> rout;
+		// names of stations and lines, the sequence number of a station name is also its number in vector "stat"
+		NameTable statNames, lineNames;
+		Graph graph;
+		// edges entering each station, target[e] is the station edge e comes from, lines of edges aren't used
+		// bidirectional Dijkstra and trees to a destination follow one-way sections in reverse on it
+		Graph reverseGraph;
+
+		/*
+		* Expanded graph of (station, line) states for line-aware search.
+		* States of station i are numbered from statStateOff[i] to statStateOff[i + 1] - 1, one for each line passing station i.
+		* Edges of stateGraph are rides along a line, and transfers between states of the same station are added during search,
+		* thus the transfer penalty can be chosen for every query.
+		*/
+		vector<int> statStateOff;
+		vector<int> stateStat;   // station of each state
+		vector<int> stateLine;   // line of each state
+		Graph stateGraph;        // lines of edges aren't used
+
+		/*
+		* Patterns of RAPTOR, which rides lines instead of walking edges.
+		* Every line is ridden in both directions, and a loop line is unrolled to almost two rounds, so that a ride may pass
+		* the station where the file begins it. A pattern stops where the line can't go on (a one-way section against its direction,
+		* or a segment where another line is shorter), and the rest of the line becomes another pattern.
+		* Stops of pattern p are patternStat[patternOff[p]] ... patternStat[patternOff[p + 1] - 1], all the arrays are flat.
+		* Closures don't change patterns, a closed segment only adds 1 to patternCut of the stops after it, and a ride
+		* never passes a cut, thus a change only computes patternDis and patternCut of the patterns through its edges again.
+		*/
+		vector<int> patternOff, patternLine;
+		vector<int> patternStat;      // station of each stop
+		vector<int> patternEdge;      // edge from the last stop to each stop, -1 for the first stop of a pattern
+		vector<double> patternDis;    // distance of each stop from the first stop of its pattern, closed segments count 0
+		vector<int> patternCut;       // closed segments from the first stop of its pattern to each stop
+		vector<int> stopPattern;      // pattern of each stop
+		vector<int> edgeStopOff, edgeStop;  // stops entered by edge e are edgeStop[edgeStopOff[e]] ... edgeStop[edgeStopOff[e + 1] - 1]
+		vector<int> statStopOff, statStop;  // stops at station i are statStop[statStopOff[i]] ... statStop[statStopOff[i + 1] - 1]
+
+		vector<Connection> connections;
+
+		/*
+		* The following functions read data from txt file and build the network.
+		* The functions are before Floyd or Dijkstra algorithm.
+		*/
+
+		/*
+		* Main function: initFromTxt()
+		*/
+		// initialize data by the txt file given, which is mapped into memory and parsed in one pass
+		void initFromTxt(const string&)throw(valueException);
+		// search by name of a station, when it exists then return sequence number, or else create a new station named this and return its number
+		int newStation(TextView);
+		// set a route whether it's loop, return false if the row is a timetable instead of a route
+		bool loopSetting(TxtScanner&, Route&)throw(valueException);
+		// read the timetable of the route just before, see Route
+		void timetableSetting(TxtScanner&, const Route&)throw(valueException);
+		// set (or create) station properties, including setting which stations are in a certain route
+		void statSetting(TxtScanner&, Route&)throw(valueException);
+		// set still properties like name in a station (including adding the station to a certain route)
+		int setStatStillProperties(TextView, Route&, int);
+		// set digital name in a station, in the format of "0101", "0215" just to meet the homework's requirements
+		void setDigName(Station&, string, int);
+		// set distance data between two stations, including adding the data to involved stations
+		void setStatDistance(char, double, Route&, int, int)throw(valueException);
+		// sub-function of setStatDistance, involving stat operations
+		void setDisOperation(double, Route&, int, int);
+		// build the CSR graph from adjacent stations recorded in stat
+		void buildGraph();
+		// expand timetables of routes into connections
+		void buildConnections();
+		// build reverseGraph from graph
+		void buildReverseGraph();
+		// build the graph of (station, line) states
+		void buildStateGraph();
+		// build patterns of RAPTOR from the lines
+		void buildPatterns();
+		// compute distances and cuts (the last two arguments) of the stops of a pattern from the weights of edges given
+		void patternWeights(int, const vector<double>&, vector<double>&, vector<int>&)const;
+	};
+	shared_ptr<const Network> net;
+	// the network to build into, it's copied first if another Metro shares it
+	// a network is only built before queries, when no other Metro can see it, and never changes once it's shared
+	Network& editNetwork();
+
+	/*
+	* Network changes at run time. A change never writes the network, it writes a copy of these instead,
+	* and a copy of the Metro shares them until it changes as well. A closed edge has a weight of INF.
+	* They're nullptr until the first change, all the weights are those of the network then.
+	*/
+	struct Changes
+	{
+		vector<double> weight;         // weights of edges of the graph
+		vector<double> openWeight;     // weights of edges when they're open, empty until the first change of a distance
+		vector<char> closedEdge;       // closed segments
+		vector<char> closedStat;       // closed stations, all edges from or to them are closed as well
+		vector<double> reverseWeight;  // weights of edges of the reverse graph and the state graph, in the same way
+		vector<double> stateWeight;
+		vector<double> patternDis;     // patternDis and patternCut of the network after the changes
+		vector<int> patternCut;
+	};
+	shared_ptr<const Changes> changes;
+	// weights and distances of stops after the changes
+	const vector<double>& edgeWeight() const { return changes ? changes->weight : net->graph.weight; }
+	const vector<double>& reverseWeight() const { return changes ? changes->reverseWeight : net->reverseGraph.weight; }
+	const vector<double>& stateWeight() const { return changes ? changes->stateWeight : net->stateGraph.weight; }
+	const vector<double>& stopDis() const { return changes ? changes->patternDis : net->patternDis; }
+	const vector<int>& stopCut() const { return changes ? changes->patternCut : net->patternCut; }
+	// a copy of the changes to write, or new ones made from the network at the first change
+	Changes& editChanges();
+
+	// shortest path tree from a source station, computed by heap-based Dijkstra
+	struct PathTree
+	{
+		vector<double> dis;  // distance from the source station, INF if can't arrive
+		vector<int> prev;    // previous station along the shortest path, -1 for the source station
+	};
+	/*
+	* A bounded cache of shortest path trees, keyed by the sequence number of source station.
+	* When it's full, the least recently used tree is dropped. Trees are shared, so a dropped tree stays alive while in use.
+	*/
+	struct TreeCache
+	{
+		mutex lock;
+		list<int> order;  // source stations from the most recently used to the least
+		unordered_map<int, pair<shared_ptr<const PathTree>, list<int>::iterator>> trees;
+		atomic<long long> hits, misses;
+
+		TreeCache() : hits(0), misses(0) {}
+		// return the tree of a source station and mark it as the most recently used, or nullptr if not cached
+		shared_ptr<const PathTree> find(int);
+		void insert(int, shared_ptr<const PathTree>);
+		// drop all trees after the network changes
+		void clear();
+	};
+	mutable TreeCache treeCache;
+	// trees to destination stations on the reverse graph, where prev is the next station along the shortest path
+	mutable TreeCache targetCache;
+	// counters of phases and queries, see MetroMetrics
+	mutable MetroMetrics metrics;
+	// add the counters of a query which has ended to metrics, routeLen is 0 if it has failed
+	void countQuery(const QueryScratch&, int, chrono::steady_clock::duration)const;
+	// get the shortest path tree of a source station from the cache, or compute and cache it
+	shared_ptr<const PathTree> sourceTree(int, QueryScratch&)const;
+	// get the shortest path tree to a destination station from the cache in the same way
+	shared_ptr<const PathTree> targetTree(int, QueryScratch&)const;
+
+	// a route found by Yen's algorithm, and the position where it leaves the route it's derived from
+	struct Candidate
+	{
+		double distance;
+		vector<int> route;
+		int deviation;
+	};
+	// at most k shortest routes without loops from source to destination by Yen's algorithm, the shortest first
+	void kShortestRoutes(int, int, int, vector<Candidate>&, QueryScratch&)const;
+	// the shortest route from a spur station to destination which avoids blocked stations and the blocked first steps,
+	// by A* guided by the exact distances to destination, it returns the distance or INF
+	double spurSearch(int, int, const PathTree&, const vector<int>&, int, const vector<int>&, vector<int>&, QueryScratch&)const;
+	// number of transfers along a route whose best lines have been selected
+	static int transferCount(const vector<LineSet>&);
+	// scratch memory owned by the calling thread, used by parallel algorithms
+	static QueryScratch& threadScratch();
+
+	/*
+	* Two double pointers to store data in the process of Floyd algorithm and the result.
+	* They're allocated only when Floyd algorithm is chosen.
+	*
+	* - Why I don't choose vector or unique_ptr?
+	* - Algorithms above is complicated. Therefore, when using vector to visit elements, it has a very low efficiency.
+	* - Therefore double pointer is the best choice for efficiency.
+	* - On my own computer, when using vector for Floyd algorithm, program crashed down after computing for several minutes.
+	*
+	* Rows are computed in one contiguous block aligned to CACHE_LINE, and leastDis[i] points to row i in the block.
+	* The side length "stride" is rounded up to a multiple of FLOYD_BLOCK, extra stations are never reachable.
+	*
+	* When compactFits, the tables are compact instead, compactDis[i] and compactPath[i] point to rows of two blocks as well,
+	* distances are whole metres in uint32_t (COMPACT_INF if can't arrive) and previous stations are uint16_t (COMPACT_NONE).
+	* They take 6 bytes an entry instead of 12, and Floyd algorithm compares 8 distances by an AVX2 instruction instead of 4.
+	* Only one of the two forms is allocated, read them by tableDis and tablePrev unless the form is known.
+	*
+	* The rows never change once a copy of the Metro can see them: a copy shares all of them, and a change which repairs
+	* the tables copies only the rows it writes (see detachRow), the other rows stay in the blocks shared with the copy.
+	*/
+	// owner of the two blocks (or two rows) of the tables when they're allocated
+	struct TableBlocks
+	{
+		void *dis, *prev;
+		TableBlocks(void *d, void *p) : dis(d), prev(p) {}
+		~TableBlocks() { alignedFree(dis); alignedFree(prev); }
+	};
+	struct Tables
+	{
+		int stride;
+		vector<double*> dis;           // rows of the tables of double and int, empty for compact tables
+		vector<int*> prev;
+		vector<uint32_t*> compactDis;  // rows of the compact tables, empty for the others
+		vector<uint16_t*> compactPrev;
+		// what each row lies in: blocks of all rows, blocks of its own, or the mapped snapshot the tables are loaded from
+		vector<shared_ptr<const void>> owner;
+
+		bool compact() const { return !compactDis.empty(); }
+	};
+	// nullptr if there're no tables
+	shared_ptr<const Tables> tables;
+	// rows of the tables above, nullptr for the form which isn't used
+	double *const *leastDis;
+	int *const *path;
+	uint32_t *const *compactDis;
+	uint16_t *const *compactPath;
+	int stride;
+	// algorithm which computed the tables or the hierarchy, 0 if there're neither
+	char tableAlg;
+
+	/*
+	* Layout of a binary snapshot, everything is in the byte order of the machine which writes it:
+	* header | section 0 | section 1 | ... each section starts at a multiple of CACHE_LINE
+	* Station and line names are stored in the order of their sequence numbers, so the numbers are kept.
+	* Adjacent stations, transfer flags and digital names of stations are rebuilt from the graph and the routes.
+	*/
+	enum SnapshotSection
+	{
+		SEC_STAT_NAME, SEC_STAT_START,   // chars of all station names, and where each name starts (int, statNum + 1)
+		SEC_LINE_NAME, SEC_LINE_START,   // chars of all line names, and where each name starts (int, lineNum + 1)
+		SEC_ROUT_ID, SEC_ROUT_LOOP,      // line name number (int) and loop flag (char) of each route
+		SEC_ROUT_OFF, SEC_ROUT_STAT,     // stations of route r are routStat[routOff[r]] ... routStat[routOff[r + 1] - 1]
+		SEC_OFFSET, SEC_TARGET,          // arrays of the CSR graph
+		SEC_WEIGHT, SEC_LINES,
+		SEC_DIS, SEC_PATH,               // leastDis and path (stride * stride), empty if there're no tables
+		SEC_CH_RANK, SEC_CH_EDGE,        // rank (int, statNum) and edges of contraction hierarchies, empty if there's no hierarchy
+		SEC_CONNECTION,                  // connections expanded from timetables, empty if there's no timetable
+		SEC_NUM
+	};
+	struct SnapshotHeader
+	{
+		char magic[8];
+		uint32_t version;
+		int32_t statNum, lineNum, routNum, edgeNum, stride, chEdgeNum, connNum;
+		char tableAlg, compact;                     // compact is 1 when the tables are uint32/uint16
+		uint64_t secOff[SEC_NUM], secLen[SEC_NUM];  // position and length of each section in bytes
+	};
+
+	// The following are small useful tool functions.
+
+	// search by the name of station and return the sequence number
+	int searchStatNum(const string&)const;
+	// get the name of a station by its sequence number
+	string getStatName(int)const;
+	// allocate new tables in the form which fits (leastDis and path, or the compact tables), and fill in the original data from the graph
+	// the compact form is never chosen if the argument is false
+	void initTables(bool = true);
+	// allocate tables of a side length in either form, entries are left as they are
+	shared_ptr<Tables> newTables(int, bool);
+	// point to the tables given (or none), and set the rows of the form they're in
+	void useTables(shared_ptr<const Tables>);
+	// whether the tables of the graph can be compact: fewer stations than COMPACT_NONE, and all the distances are whole metres
+	// whose sum is less than COMPACT_INF, thus no shortest distance can reach it
+	bool compactFits()const;
+	// whether the tables have been computed, in either form
+	bool hasTables() const { return tables != nullptr; }
+	// an entry of the tables in either form, INF and -1 if can't arrive
+	double tableDis(int i, int j) const
+	{
+		if (compactDis == nullptr)
+			return leastDis[i][j];
+		uint32_t dis = compactDis[i][j];
+		return dis == COMPACT_INF ? INF : dis;
+	}
+	int tablePrev(int i, int j) const
+	{
+		if (compactPath == nullptr)
+			return path[i][j];
+		uint16_t prev = compactPath[i][j];
+		return prev == COMPACT_NONE ? -1 : prev;
+	}
+	void setTableEntry(int i, int j, double dis, int prev)
+	{
+		if (compactDis == nullptr)
+		{
+			leastDis[i][j] = dis;
+			path[i][j] = prev;
+			return;
+		}
+		compactDis[i][j] = dis == INF ? COMPACT_INF : (uint32_t)dis;
+		compactPath[i][j] = prev < 0 ? COMPACT_NONE : prev;
+	}
+	// allocate and free memory aligned to CACHE_LINE
+	static void* alignedAlloc(size_t);
+	static void alignedFree(void*);
+	// run a task for all numbers from 0 to count - 1 on the work-stealing pool
+	template<typename Func>
+	static void parallelFor(int, Func);
+
+	// read data from txt, or from a binary snapshot if passed in, into a new network
+	void loadData(const char*)throw(valueException);
+	// write all data into a binary snapshot, including leastDis and path when they have been computed
+	void saveSnapshot(const string&)const throw(valueException);
+	// initialize data by a binary snapshot instead of the txt file, leastDis and path are used directly from the mapped file
+	void loadSnapshot(Network&, const string&)throw(valueException);
+	// sub-function of loadSnapshot, check the length of a section in the mapped file and return its address
+	template<typename T>
+	static const T* snapSection(const MappedFile&, const SnapshotHeader&, int, size_t)throw(valueException);
+
+	// Algorithms for computing the shortest path, including Floyd and Dijkstra.
+	// tables of both algorithms are compact if they fit, unless the argument is false
+	void Floyd(bool = true);
+	// sub-function of Floyd, relax a tile of the tables through the stations in a diagonal tile
+	void floydTile(int, int, int);
+	// the same on the rows of either form
+	template<typename Dis, typename Prev>
+	void floydTile(Dis *const*, Prev *const*, Dis, int, int, int);
+	// sub-function of floydTile, relax FLOYD_BLOCK elements in a row through a station
+	static void minPlusRow(double*, int*, const double*, const int*, double);
+	static void minPlusRow(uint32_t*, uint16_t*, const uint32_t*, const uint16_t*, uint32_t);
+	// all pairs shortest paths by heap-based Dijkstra from every station, the sources are run in parallel
+	void allPairsDijkstra(bool = true);
+	// fill the row of a source station in the tables by heap-based Dijkstra
+	void tableRow(int, QueryScratch&);
+
+	// the station an edge leaves from
+	int edgeSource(int)const;
+	// set weights of the edges again after closures or distances change, then repair what has been computed
+	void applyChange(Changes&, const vector<int>&);
+	// repair the tables after the weights of the edges in the first vector increase and those in the second one decrease
+	void repairTables(const vector<int>&, const vector<int>&);
+	// give row s of the tables being repaired memory of its own, and copy the shared row into it when the last argument is true
+	void detachRow(Tables&, int, bool);
+	// turn compact tables into new tables of double and int, when a change gives a distance they can't hold
+	void widenTables();
+	// whether the hierarchy or the skeleton chosen has been dropped by a change, searches go by bidirectional Dijkstra then
+	bool indexStale() const { return (alg == 'c' && !hierarchy) || (alg == 's' && !skeleton); }
+	// build the hierarchy or the skeleton dropped by changes again
+	void rebuildIndex();
+	// Dijkstra searching forward from the source and backward from the destination in turn, it stops when they meet
+	// it returns the station where the shortest path is joined, or -1 if can't arrive
+	int bidirectionalDijkstra(int, int, QueryScratch&)const;
+	// contract all stations and build the hierarchy, it's an offline phase before queries
+	void contractHierarchy();
+	// build upward edges of a hierarchy from its ranks and edges
+	static void buildHierarchyGraph(Hierarchy&);
+	// upward Dijkstra from both the source and the destination on the hierarchy
+	// it returns the station where the shortest path is joined, or -1 if can't arrive
+	// previous and next "stations" in the scratch are numbers of hierarchy edges
+	int hierarchyDijkstra(int, int, QueryScratch&)const;
+	// find chains and skeleton stations, and compute the tables between skeleton stations
+	void buildSkeleton();
+	// distance between two positions in the same chain, INF if a one-way section is against the direction
+	double chainDis(int, int)const;
+	// ends where a route leaves (or enters, when the second argument is false) the skeleton from a station, return their number
+	int skeletonEnds(int, bool, SkeletonEnd*)const;
+	// shortest distance by the skeleton, the ends used are returned, or two ends of -1 if it's along the same chain
+	double skeletonQuery(int, int, SkeletonEnd&, SkeletonEnd&)const;
+	// Dijkstra on the states, minimizing total distance plus transfer penalty (the third argument) for every transfer
+	// it returns the first state of the destination which is settled, or -1 if can't arrive
+	int lineAwareDijkstra(int, int, double, QueryScratch&)const;
+	// heap-based Dijkstra from a source station, it stops when the destination is settled (or settles all stations when destination is -1)
+	// the result is written into the scratch, and the distance to destination is returned
+	double heapDijkstra(int src, int des, QueryScratch &scratch)const { return heapDijkstra(net->graph, edgeWeight(), src, des, scratch); }
+	// the same on another graph and its weights, such as the reverse graph
+	double heapDijkstra(const Graph&, const vector<double>&, int, int, QueryScratch&)const;
+	// Dijkstra from a source station stopping at a distance, or when all the targets marked in isMarked of the scratch
+	// (the number is passed in) are settled, settled stations are appended to route of the scratch, the nearest first
+	void boundedDijkstra(int, double, int, QueryScratch&)const;
+	// distances from a source station to targets (-1 for unknown stations), written into the array
+	void oneToMany(int, const vector<int>&, double*, QueryScratch&)const;
+	// RAPTOR from a source station, round k finds the shortest distances by at most k rides, it returns the number of rounds
+	int raptor(int, int, QueryScratch&)const;
+	// rounds after which the distance to destination becomes shorter, each gives a route of the Pareto set
+	void paretoRounds(int, int, const QueryScratch&, vector<int>&)const;
+	// walk rides back from destination after a round, the lines of each section are the lines serving the whole ride
+	void raptorRoute(int, int, int, const QueryScratch&, vector<int>&, vector<LineSet>&)const;
+	// Connection Scan from a source station leaving at a time, arrival times are in dis of the scratch,
+	// and prev is the connection arriving there, it returns false if it can't arrive
+	bool connectionScan(int, int, int, QueryScratch&)const;
+	// connections taken to destination after a scan, in order
+	void connectionRoute(int, const QueryScratch&, vector<int>&)const;
+
+	/*
+	* The following functions are after Floyd or Dijkstra algorithm.
+	*/
+
+	/*
+	* After Dijkstra or Floyd algorithm, we get the shortest distance.
+	* Now we should compute the whole path, that is, all the stations we'll pass along the shortest path.
+	*/
+	// get the shortest path between two stations by their names from the tables, return false if failed
+	// stations are written into the vector given, which can be reused by the caller for every query
+	bool searchRoute(const string&, const string&, vector<int>&, QueryScratch&)const throw(valueException);
+	// get the shortest path between two stations by their names with the heap-based Dijkstra engine, return false if failed
+	// shortest path trees are cached, thus queries from the same source station are answered without searching again
+	bool heapSearchRoute(const string&, const string&, vector<int>&, QueryScratch&)const throw(valueException);
+	// walk previous stations back from a destination to get the whole path
+	void treeRoute(const int*, int, vector<int>&)const;
+	// get the complete route (all the passed stations) by the skeleton, return false if failed
+	bool skeletonSearchRoute(const string&, const string&, vector<int>&, QueryScratch&)const throw(valueException);
+	// append stations along a chain, from the first position (excluded) to the second one
+	void chainRoute(int, int, vector<int>&)const;
+	// get the complete route (all the passed stations) by contraction hierarchies, return false if failed
+	bool hierarchySearchRoute(const string&, const string&, vector<int>&, QueryScratch&)const throw(valueException);
+	// replace a hierarchy edge with the original edges it's made of, and append their stations except the first one
+	void unpackEdge(int, vector<int>&)const;
+	// get the complete route (all the passed stations) by bidirectional Dijkstra, return false if failed
+	bool bidirectionalSearchRoute(const string&, const string&, vector<int>&, QueryScratch&)const throw(valueException);
+	// get the best route between two stations by their names with line-aware Dijkstra, return false if failed
+	// stations are written into scratch.route, and the line of each section into scratch.lines
+	bool lineAwareSearchRoute(const string&, const string&, double, QueryScratch&)const throw(valueException);
+	// walk previous states back from the last state to get the whole path and its lines
+	void stateRoute(const QueryScratch&, int, vector<int>&, vector<LineSet>&)const;
+	// get the shortest route with the fewest transfers by RAPTOR, return false if failed
+	// stations are written into scratch.route, and lines of each section into scratch.lines
+	bool raptorSearchRoute(const string&, const string&, QueryScratch&)const throw(valueException);
 	/*
-	* We choose two adjacent stations and insert a new one between them.
-	* But after insertion, though the subscript of the former station won't change, the latter one will.
-	* To solve this, we find that the distance from the latter one to the end of the array won't change.
-	* Thus we use variable "disFromEnd" to record the position of the latter station.
+	* After getting the whole path, now we want to compute which route to choose between two stations.
+	* Compute all available routes along the shortest path.
+	*/
+	void availableRoute(const int*, int, vector<LineSet>&)const;
+	/*
+	* After getting all available routes, we want the "best" ones.
+	* Now I'll get the best routes from all available routes in function bestRoutSelect.
+	*/
+	void bestRoutSelect(vector<LineSet>&)const;
+
+	/*
+	* Now almost everything has been done. We've got the "best routes".
+	* We just have to create an I/O interface, or we can call it an API.
+	* The following are sub-functions invoked by function userAPI().
+	*/
+	// input source place and destination place, then search and print out the best route and some more details
+	void userSearch()throw(valueException);
+	// search the route by the algorithm chosen, stations are written into scratch.route and lines of sections into scratch.lines
+	bool findRoute(const string&, const string&, QueryScratch&)const throw(valueException);
+	// compute what the algorithm chosen needs before queries, it tells how it goes when the argument is true
+	void buildEngine(bool)throw(valueException);
+	// sub-function of userSearch(), which print out the best route
+	void printRoute(int*, int, const vector<LineSet>&);
+	// stations and lines of a route, in the format of printRoute
+	void printSections(int*, int, const vector<LineSet>&);
+	// sub-function of userAPI, which searches and prints out alternative routes
+	void userAlternatives()throw(valueException);
+	// sub-function of userAPI, which searches and prints out the Pareto set of routes
+	void userPareto()throw(valueException);
+	// sub-function of userAPI, which searches and prints out the earliest arrival by timetables
+	void userDepart()throw(valueException);
+	// sub-function of userSearch(), which print out details about the route
+	void printDetails(int*, int);
+
+	/*
+	* Batch mode: queries are read from a file and results are written as lines of text.
 	*/
-	int pathNum = path[init[k]][init[k + 1]], disFromEnd = init_len - k - 1;
+	// a query in batch mode
+	struct BatchQuery
+	{
+		int no;          // the query is the no-th one in the file, starting from 1
+		int src, des;    // sequence numbers of stations, -1 if not found
+		string srcName, desName;
+	};
+	// answer all queries from the same source station with one shortest path tree, and write the result lines
+	void batchGroup(const BatchQuery*, int, ostream&)const;
+
+public:
+	// constructors, a Metro serves the city in the txt file given
+	explicit Metro(const string& = DEFAULT_SRC);
+	Metro(const Metro&);
+	Metro(Metro&&);
+
+	// The main API function to implement user interface.
+	// when a binary snapshot is passed in, data are loaded from it instead of the txt file
+	void userAPI(const char* = nullptr);
+	// read the txt file, compute tables or the hierarchy by the chosen algorithm (d/f/p/c) and write a binary snapshot
+	void makeSnapshot(const string&, char);
+	// batch mode: read pairs of source and destination from a file (or standard input for "-"), and write one line per query
+	void batchAPI(const string&, const char* = nullptr);
+	// read names of sources and targets from two files (either may be standard input for "-"), and write the distance table
+	void tableAPI(const string&, const string&, const char* = nullptr);
+	// write stations within a distance of a source station, one line per station
+	void isochroneAPI(const string&, double, const char* = nullptr);
+	// load data (from a binary snapshot if passed in) and compute what the algorithm needs, without asking anything
+	void prepare(char, const char* = nullptr)throw(valueException);
+	// the two steps of prepare, separated so that they can be timed: load data, then compute what the algorithm needs
+	void load(const char* = nullptr)throw(valueException);
+	void build(char)throw(valueException);
+	// names of all stations, in the order of their sequence numbers
+	vector<string> stationNames()const;
+	// bytes held by the graphs and the tables of the algorithm prepared, names and cached trees aren't counted
+	size_t memoryUsage()const;
+	// counters of phases and queries since the engine was created
+	// the cache counters are taken from the two tree caches, which are the only place they're counted
+	const MetroMetrics& getMetrics()const
+	{
+		metrics.set(MetroMetrics::CACHE_HITS, treeCache.hits + targetCache.hits);
+		metrics.set(MetroMetrics::CACHE_MISSES, treeCache.misses + targetCache.misses);
+		return metrics;
+	}
+	// search the route between two stations by their names, names of passed stations are written into the vector
+	// and names of the lines to choose for each section into the last one if passed in
+	// it returns the distance, or INF if failed, and it's safe to call from many threads at the same time
+	double search(const string&, const string&, vector<string>&, vector<vector<string>>* = nullptr)const;
+	// whether there's a station of the name
+	bool hasStation(const string &name) const { return searchStatNum(name) >= 0; }
+
+	// one of alternative routes
+	struct Itinerary
+	{
+		double distance;
+		int transfers;
+		vector<string> stations;
+		vector<vector<string>> lines;  // lines to choose for each section
+	};
+	// search at most k shortest routes without loops between two stations, the shortest first
+	// it's empty if a station is unknown or it can't arrive, and it's safe to call from many threads at the same time
+	vector<Itinerary> alternatives(const string&, const string&, int)const;
+	// search the Pareto set of routes trading distance against transfers by RAPTOR, the fewest transfers first
+	// every route is shorter than all those with fewer transfers, and it's empty in the same cases as above
+	vector<Itinerary> paretoRoutes(const string&, const string&)const;
+
+	// a journey by timetables, times are seconds after midnight of the service day
+	struct Journey
+	{
+		int departure, arrival;        // when the first train leaves and the last one arrives
+		int transfers;
+		vector<string> stations;
+		vector<int> times;             // when each station is left (the source) or reached (the others)
+		vector<vector<string>> lines;  // line of each section, only one, in the same form as Itinerary
+	};
+	// whether any route has a timetable
+	bool hasTimetable() const { return !net->connections.empty(); }
+	// search the earliest arrival at destination leaving the source at a time by Connection Scan over timetables
+	// it returns false if a station is unknown or it can't arrive on the service day, and it's safe to call from many threads
+	bool earliestArrival(const string&, const string&, int, Journey&)const;
+
+	// distances from a source station to each target, INF for an unknown station or if it can't arrive, routes aren't walked
+	// one search from the source serves all the targets and stops when they're all reached, or tables are read if computed
+	vector<double> distances(const string&, const vector<string>&)const;
+	// distances from each source to each target, row by row (sources.size() * targets.size()), sources are searched in parallel
+	vector<double> distanceTable(const vector<string>&, const vector<string>&)const;
+	// stations within a distance of a source station and their distances, the nearest first, the search stops at the distance
+	// they're safe to call from many threads at the same time
+	void isochrone(const string&, double, vector<string>&, vector<double>&)const;
+private:
+	// an itinerary of a route, with names of the stations and lines
+	Itinerary makeItinerary(double, const vector<int>&, const vector<LineSet>&)const;
+
+	// close (when the last argument is true) or reopen a station, or a segment from the first station to the second one
+	// and change the distance of a segment, what has been computed is repaired at once
+	// they return false if the station or the segment doesn't exist, or the distance isn't positive
+	// they change the engine in place, thus only MetroRegistry calls them, on a copy which no query can see until it's swapped in
+	bool setStationClosed(const string&, bool);
+	bool setSegmentClosed(const string&, const string&, bool);
+	bool setSegmentWeight(const string&, const string&, double);
+	friend class MetroRegistry;
+	friend class MetroCheck;
+};
+
+// a struct to hold information about a station
+struct Metro::Station
+{
+	struct Node
+	{
+		int nextStat;         // from this station, which station we can directly go to (that is, adjacent stations)
+		LineSet path;         // to go to the station mentioned above, which routes we can choose
+		double distance;      // distance to the station mentioned above
+	};
+
+	vector<Node> next;        // as described above, it tells us information about adjacent stations
+	string name;              // name of this station
+	vector<string> digName;   // digital names of this station, like "0101"(1st station in route 1) "0213"(13th station in route 2), just to meet the requirements of homework
+	bool isTrans;             // whether it's a transfer station
+
+	// useful function tools
+
+	// find the node of an adjacent station, return nullptr if not found
+	Node* findNode(int num)
+	{
+		for (vector<Node>::iterator iter = next.begin(); iter != next.end(); ++iter)
+			if ((*iter).nextStat == num)
+				return &*iter;
+		return nullptr;
+	}
+
+	// add a new node to vector "next" if the added adjacent station doesn't exist, or else directly add a new path
+	void addNode(int myPath, int num, double distance)
+	{
+		Node *node = findNode(num);
+		if (node != nullptr)
+			node->path.set(myPath);
+		else
+		{
+			Node tempNode;
+			tempNode.nextStat = num;
+			tempNode.path.set(myPath);
+			tempNode.distance = distance;
+			next.push_back(tempNode);
+		}
+	}
+
+	// clear the paths in a node
+	void clearNodePath(int num)
+	{
+		Node *node = findNode(num);
+		if (node != nullptr)
+			node->path.clear();
+	}
+};
+
+// a struct to hold information about a route
+struct Metro::Route
+{
+	string name;            // name of this route, either number or Chinese characters or something else
+	int id;                 // sequence number of the name in lineNames, routes with the same name are the same line
+	vector<int> myStat;     // which stations this route passes
+	bool isLoop;            // whether the route is loop or not
+	// sections as read from the txt file, used to expand the timetable, they're empty for routes from a snapshot
+	vector<double> myDis;   // distance of each section
+	vector<char> myDirec;   // direction of each section, 'b', 'u' or 'd'
+	// the timetable: the first and the last trains leave either terminal at first and last (seconds after midnight),
+	// and trains leave every headway[i] seconds on section i, headway is empty if the route has no timetable
+	int first, last;
+	vector<double> headway;
+};
+
+// search for a station whose name is matched with the passed-in argument
+int Metro::searchStatNum(const string &name)const
+{
+	return net->statNames.find(name);          // the sequence number, or -1 to show "not found"
+}
+
+// get a station's name by its sequence number
+string Metro::getStatName(int num)const
+{
+	return net->stat[num].name;
+}
+
+// set up a new station if the name doesn't exist
+// or else return the sequence number of the station whose name is matched with passed-in argument
+int Metro::Network::newStation(TextView name)
+{
+	int whichStat = statNames.intern(name.str, name.len); // a new name gets the next sequence number
+
+	// the following set up a new station if the name not found
+	if (whichStat == (int)stat.size())
+	{
+		Station temp;
+		temp.name.assign(name.str, name.len);
+
+		// when first set up while reading data from routes in txt, it has been passed for only once
+		// therefore it's not a transfer station
+		temp.isTrans = false;
+
+		stat.push_back(temp);
+	}
+	// if the station already exists, it's the second time visited, thus it's a transfer station
+	else stat[whichStat].isTrans = true;
+	return whichStat;
+}
+
+// allocate leastDis and path
+// default value of leastDis[i][j]: 0 when i=j, the distance when j is adjacent to i, or else infinity
+// default value of path[i][j]: i when i=j or j is adjacent to i, or else -1
+void Metro::initTables(bool compact)
+{
+	int n = net->graph.size();
+	shared_ptr<Tables> next = newTables((n + FLOYD_BLOCK - 1) / FLOYD_BLOCK * FLOYD_BLOCK, compact && compactFits());
+	size_t size = (size_t)next->stride * next->stride;
+	if (next->compact())
+	{
+		fill(next->compactDis[0], next->compactDis[0] + size, COMPACT_INF);
+		fill(next->compactPrev[0], next->compactPrev[0] + size, COMPACT_NONE);
+	}
+	else if (size > 0)
+	{
+		fill(next->dis[0], next->dis[0] + size, INF);
+		fill(next->prev[0], next->prev[0] + size, -1);
+	}
+	useTables(next);
+
+	const vector<double> &weight = edgeWeight();
+	for (int i = 0; i < n; ++i)
+	{
+		setTableEntry(i, i, 0, i);
+		for (int e = net->graph.offset[i]; e < net->graph.offset[i + 1]; ++e)
+			setTableEntry(i, net->graph.target[e], weight[e], weight[e] == INF ? -1 : i);
+	}
+}
+
+// rows lie one after another in the two blocks
+shared_ptr<Metro::Tables> Metro::newTables(int rows, bool compact)
+{
+	shared_ptr<Tables> next = make_shared<Tables>();
+	next->stride = rows;
+	size_t size = (size_t)rows * rows;
+	if (compact)
+	{
+		uint32_t *dis = (uint32_t*)alignedAlloc(sizeof(uint32_t) * size);
+		uint16_t *prev = (uint16_t*)alignedAlloc(sizeof(uint16_t) * size);
+		next->owner.assign(rows, make_shared<TableBlocks>(dis, prev));
+		for (int i = 0; i < rows; ++i)
+		{
+			next->compactDis.push_back(dis + (size_t)i * rows);
+			next->compactPrev.push_back(prev + (size_t)i * rows);
+		}
+	}
+	else
+	{
+		double *dis = (double*)alignedAlloc(sizeof(double) * size);
+		int *prev = (int*)alignedAlloc(sizeof(int) * size);
+		next->owner.assign(rows, make_shared<TableBlocks>(dis, prev));
+		for (int i = 0; i < rows; ++i)
+		{
+			next->dis.push_back(dis + (size_t)i * rows);
+			next->prev.push_back(prev + (size_t)i * rows);
+		}
+	}
+	METRIC_COUNT(metrics, ALLOCATIONS, 2);
+	return next;
+}
+
+void Metro::useTables(shared_ptr<const Tables> next)
+{
+	tables = next;
+	leastDis = nullptr;
+	path = nullptr;
+	compactDis = nullptr;
+	compactPath = nullptr;
+	stride = tables ? tables->stride : 0;
+	if (tables && tables->compact())
+	{
+		compactDis = tables->compactDis.data();
+		compactPath = tables->compactPrev.data();
+	}
+	else if (tables)
+	{
+		leastDis = tables->dis.data();
+		path = tables->prev.data();
+	}
+}
+
+bool Metro::compactFits()const
+{
+	const vector<double> &weight = edgeWeight();
+	if (!COMPACT_TABLES || net->graph.size() >= COMPACT_NONE)
+		return false;
+	double sum = 0;
+	for (vector<double>::const_iterator iter = weight.begin(); iter != weight.end(); ++iter)
+		if (*iter != INF)
+		{
+			if (*iter != floor(*iter))
+				return false;
+			sum += *iter;
+		}
+	return sum < COMPACT_INF;
+}
+
+// the original address returned by new is stored just before the aligned address
+void* Metro::alignedAlloc(size_t size)
+{
+	char *raw = new char[size + CACHE_LINE + sizeof(char*)];
+	char *aligned = raw + sizeof(char*);
+	aligned += (CACHE_LINE - (size_t)aligned % CACHE_LINE) % CACHE_LINE;
+	((char**)aligned)[-1] = raw;
+	return aligned;
+}
+
+void Metro::alignedFree(void *ptr)
+{
+	if (ptr != nullptr)
+		delete[] ((char**)ptr)[-1];
+}
+
+// the numbers are cut into several chunks for each worker, so that idle workers can steal the remaining ones
+// the calling thread runs pending tasks too while waiting, thus parallelFor can be nested
+template<typename Func>
+void Metro::parallelFor(int count, Func task)
+{
+	WorkStealingPool &pool = WorkStealingPool::instance();
+	int chunks = min(count, pool.size() * 4);
+	if (chunks <= 1)
+	{
+		for (int i = 0; i < count; ++i)
+			task(i);
+		return;
+	}
+
+	// the state of completion lives on this stack, thus it's only touched under doneLock,
+	// and the last task has released the lock before this function can see nothing remaining
+	int remaining = chunks;
+	mutex doneLock;
+	condition_variable done;
+	for (int c = 0; c < chunks; ++c)
+	{
+		int begin = (long long)count * c / chunks, end = (long long)count * (c + 1) / chunks;
+		pool.submit([&, begin, end]() {
+			for (int i = begin; i < end; ++i)
+				task(i);
+			lock_guard<mutex> guard(doneLock);
+			if (--remaining == 0)
+				done.notify_all();
+		});
+	}
+	for (;;)
+	{
+		{
+			lock_guard<mutex> guard(doneLock);
+			if (remaining == 0)
+				return;
+		}
+		if (!pool.helpOnce())
+		{
+			unique_lock<mutex> guard(doneLock);
+			done.wait_for(guard, chrono::milliseconds(1), [&]() { return remaining == 0; });
+		}
+	}
+}
+
+void Metro::Network::initFromTxt(const string &fileSrc)throw(valueException)
+{
+	// names are views into the mapped file, thus nothing is copied until a new name is interned
+	MappedFile file;
+	if (!file.open(fileSrc))
+	{
+		cout << "Invalid file directory!" << endl;
+		throw valueException("File Open Failed");
+	}
+	TxtScanner scanner(file.data(), file.size());
+
+	// read data in each line in txt, empty lines are ignored
+	while (scanner.nextLine())
+	{
+		// record route number
+		Route routTemp;
+		TextView name = scanner.token("line name");
+		routTemp.name.assign(name.str, name.len);
+		routTemp.id = lineNames.intern(name.str, name.len);
+		if (routTemp.id >= MAX_LINE_NUM)
+		{
+			cout << "Too many lines!" << endl;
+			throw valueException(routTemp.name);
+		}
+		// set whether loop, or read the timetable of the last route
+		if (!loopSetting(scanner, routTemp))
+		{
+			timetableSetting(scanner, routTemp);
+			continue;
+		}
+		// begin to read stations, distances and directions
+		statSetting(scanner, routTemp);
+		rout.push_back(routTemp);
+	}
+	file.close();
+	// compress adjacent stations into the CSR graph
+	buildGraph();
+	buildConnections();
+}
+
+// set whether a route is loop, a flag of 't' begins a timetable row
+bool Metro::Network::loopSetting(TxtScanner &scanner, Route &temp)throw(valueException)
+{
+	char flag = scanner.flag("loop flag", "ynt");
+	temp.isLoop = flag == 'y';
+	return flag != 't';
+}
+
+/*
+* A timetable row follows the row of its route, with the same line name and a flag of 't':
+* "name t first last headway...", like "1 t 5:10 23:00 3 3 5", times are "h:mm" and headways are in minutes.
+* Each section of the route has a headway, and the last one is used for the rest sections if there're fewer.
+*/
+void Metro::Network::timetableSetting(TxtScanner &scanner, const Route &temp)throw(valueException)
+{
+	if (rout.empty() || rout.back().id != temp.id || !rout.back().headway.empty())
+		scanner.fail("timetable without its route");
+	Route &route = rout.back();
+	route.first = scanner.clock("first train");
+	route.last = scanner.clock("last train");
+	// the last train leaves after midnight
+	if (route.last < route.first)
+		route.last += 24 * 3600;
+	do
+	{
+		if (route.headway.size() >= route.myDis.size())
+			scanner.fail("too many headways");
+		double headway = scanner.number("headway") * 60;
+		if (headway <= 0)
+			scanner.fail("wrong headway");
+		route.headway.push_back(headway);
+	} while (!scanner.lineEnd());
+	route.headway.resize(route.myDis.size(), route.headway.back());
+}
+
+void Metro::Network::statSetting(TxtScanner &scanner, Route &temp)throw(valueException)
+{
+	// direc means direction
+	char direc;
+	// counter records the sequence number of each station in a route, like 1 means the 1st station (departure) in a route
+	// preNum and sufNum records sequence number of two adjacent stations, preNum is the former one, and sufNum is the latter
+	int counter = 1, preNum, sufNum;
+	// distance between two adjacent stations
+	double distance;
+
+	// initialization of the first station in a route
+	preNum = setStatStillProperties(scanner.token("station name"), temp, counter);
+
+	// when the line doesn't end
+	while (!scanner.lineEnd())
+	{
+		// read data
+		distance = scanner.number("distance");
+		direc = scanner.flag("direction", "bud");
+		++counter; // since it's the next station, counter adds 1
+
+		// set station and route information
+		sufNum = setStatStillProperties(scanner.token("station name"), temp, counter);
+		setStatDistance(direc, distance, temp, preNum, sufNum);
+		temp.myDis.push_back(distance);
+		temp.myDirec.push_back(direc);
+
+		// the latter station will become the former one
+		preNum = sufNum;
+	}
+}
+
+// mainly set station information, including adding it to the route
+int Metro::Network::setStatStillProperties(TextView name, Route &temp, int counter)
+{
+	// if existing, then return the sequence number, or else create a new one then return its number
+	int num = newStation(name);
+	// add it to the route
+	temp.myStat.push_back(num);
+	// set digital names in the station, like "0101" "0213", as required in the homework
+	setDigName(stat[num], temp.name, counter);
+
+	return num;
+}
+
+void Metro::Network::setDigName(Station &myStat, string routName, int counter)
+{
+	// use the counter and the route name
+	char digName[3] = { 0 };
+	if (routName.size() == 1)
+		routName.insert(0, "0");
+	digName[0] = counter / 10 + '0';
+	digName[1] = counter % 10 + '0';
+	routName += digName;
+	myStat.digName.push_back(routName);
+}
+
+// mainly set distance data between 2 stations
+void Metro::Network::setStatDistance(char direc, double distance, Route &temp, int preNum, int sufNum)throw(valueException)
+{
+	try
+	{
+		// decide according to the route diretion between 2 stations
+		switch (direc)
+		{
+		// 'b'(both) means both directions are ok, 'u'(up) means from former to latter, 'd'(down) means from latter to former
+		case'b': setDisOperation(distance, temp, preNum, sufNum); setDisOperation(distance, temp, sufNum, preNum); break;
+		case'u': setDisOperation(distance, temp, preNum, sufNum); break;
+		case'd': setDisOperation(distance, temp, sufNum, preNum); break;
+		default: throw valueException(direc);
+		}
+	}
+	catch (valueException &ex) { cout << ex.what(); ex.printValue(); cout << endl; }
+}
+
+// detailed operation process
+void Metro::Network::setDisOperation(double distance, Route &temp, int preNum, int sufNum)
+{
+	Station::Node *node = stat[preNum].findNode(sufNum);
+
+	// if never set distance data between the 2 stations
+	if (node == nullptr)
+		stat[preNum].addNode(temp.id, sufNum, distance); // add data to relevant station
+
+	// if have already set the data once, twice or more times
+	// when distance is shorter than former ones
+	else if (distance < node->distance)
+	{
+		stat[preNum].clearNodePath(sufNum); // clear path data of the station
+		node->distance = distance;          // reset distance
+		stat[preNum].addNode(temp.id, sufNum, distance);
+	}
+	else if (distance == node->distance)
+		stat[preNum].addNode(temp.id, sufNum, distance); // just add data to the station
+}
+
+// build the CSR graph, edges leaving the same station are stored together in the order of vector "next"
+void Metro::Network::buildGraph()
+{
+	int n = stat.size();
+	graph.offset.assign(n + 1, 0);
+	for (int i = 0; i < n; ++i)
+		graph.offset[i + 1] = graph.offset[i] + stat[i].next.size();
+
+	int m = graph.offset[n];
+	graph.target.resize(m);
+	graph.weight.resize(m);
+	graph.lines.resize(m);
+
+	int e = 0;
+	for (int i = 0; i < n; ++i)
+		for (vector<Station::Node>::iterator iter = stat[i].next.begin(); iter != stat[i].next.end(); ++iter, ++e)
+		{
+			graph.target[e] = (*iter).nextStat;
+			graph.weight[e] = (*iter).distance;
+			graph.lines[e] = (*iter).path;
+		}
+}
+
+/*
+* Trains of a route leave either terminal from the first train to the last one, and run along the route at TRAIN_SPEED.
+* On each section they leave every headway of the section, counted from the time the first train passes there,
+* thus sections with shorter headways have more trains. Sections are ridden only in the directions of the txt file.
+*/
+void Metro::Network::buildConnections()
+{
+	connections.clear();
+	for (vector<Route>::const_iterator iter = rout.begin(); iter != rout.end(); ++iter)
+	{
+		const Route &route = *iter;
+		int sections = route.headway.size();
+		for (int direc = 0; direc < 2; ++direc)
+		{
+			// time to run from the terminal to the section
+			double offset = 0;
+			for (int k = 0; k < sections; ++k)
+			{
+				int i = direc == 0 ? k : sections - 1 - k;
+				int from = route.myStat[direc == 0 ? i : i + 1], to = route.myStat[direc == 0 ? i + 1 : i];
+				double run = route.myDis[i] / TRAIN_SPEED;
+				if (route.myDirec[i] == 'b' || route.myDirec[i] == (direc == 0 ? 'u' : 'd'))
+				{
+					int edge = graph.findEdge(from, to);
+					for (double depart = route.first + offset; depart <= route.last + offset; depart += route.headway[i])
+					{
+						Connection conn = { (int)(depart + 0.5), (int)(depart + run + 0.5), from, to, edge, route.id };
+						connections.push_back(conn);
+					}
+				}
+				offset += run;
+			}
+		}
+	}
+	stable_sort(connections.begin(), connections.end(), [](const Connection &a, const Connection &b) { return a.departure < b.departure; });
+}
+
+void Metro::saveSnapshot(const string &snapSrc)const throw(valueException)
+{
+	ofstream file(snapSrc, ios::binary);
+	if (!file)
+	{
+		cout << "Invalid file directory!" << endl;
+		throw valueException(snapSrc);
+	}
+
+	// names are stored one after another
+	vector<char> statName, lineName;
+	vector<int> statStart(1, 0), lineStart(1, 0);
+	for (int i = 0; i < net->statNames.size(); ++i)
+	{
+		string name = net->statNames.name(i);
+		statName.insert(statName.end(), name.begin(), name.end());
+		statStart.push_back(statName.size());
+	}
+	for (int i = 0; i < net->lineNames.size(); ++i)
+	{
+		string name = net->lineNames.name(i);
+		lineName.insert(lineName.end(), name.begin(), name.end());
+		lineStart.push_back(lineName.size());
+	}
+
+	vector<int> routId, routOff(1, 0), routStat;
+	vector<char> routLoop;
+	for (vector<Route>::const_iterator iter = net->rout.begin(); iter != net->rout.end(); ++iter)
+	{
+		routId.push_back((*iter).id);
+		routLoop.push_back((*iter).isLoop);
+		routStat.insert(routStat.end(), (*iter).myStat.begin(), (*iter).myStat.end());
+		routOff.push_back(routStat.size());
+	}
+
+	SnapshotHeader head;
+	memset(&head, 0, sizeof(head));
+	memcpy(head.magic, SNAPSHOT_MAGIC, sizeof(head.magic));
+	head.version = SNAPSHOT_VERSION;
+	head.statNum = net->stat.size();
+	head.lineNum = net->lineNames.size();
+	head.routNum = net->rout.size();
+	head.edgeNum = net->graph.target.size();
+	head.stride = hasTables() ? stride : 0;
+	head.compact = compactDis != nullptr;
+	// an engine without the hierarchy writes an empty one
+	static const Hierarchy none;
+	const Hierarchy &ch = hierarchy ? *hierarchy : none;
+	head.chEdgeNum = ch.edges.size();
+	head.connNum = net->connections.size();
+	head.tableAlg = tableAlg;
+
+	const void *secData[SEC_NUM] = {
+		statName.data(), statStart.data(), lineName.data(), lineStart.data(),
+		routId.data(), routLoop.data(), routOff.data(), routStat.data(),
+		net->graph.offset.data(), net->graph.target.data(), edgeWeight().data(), net->graph.lines.data(),
+		nullptr, nullptr,
+		ch.rank.data(), ch.edges.data(), net->connections.data() };
+	size_t tableSize = (size_t)head.stride * head.stride;
+	uint64_t secLen[SEC_NUM] = {
+		statName.size(), statStart.size() * sizeof(int), lineName.size(), lineStart.size() * sizeof(int),
+		routId.size() * sizeof(int), routLoop.size(), routOff.size() * sizeof(int), routStat.size() * sizeof(int),
+		net->graph.offset.size() * sizeof(int), net->graph.target.size() * sizeof(int), edgeWeight().size() * sizeof(double), net->graph.lines.size() * sizeof(LineSet),
+		tableSize * (head.compact ? sizeof(uint32_t) : sizeof(double)), tableSize * (head.compact ? sizeof(uint16_t) : sizeof(int)),
+		ch.rank.size() * sizeof(int), ch.edges.size() * sizeof(HierarchyEdge), net->connections.size() * sizeof(Connection) };
+	// rows of the tables lie apart after changes, thus they're written one by one
+	auto tableRowData = [&](int sec, int i) {
+		if (sec == SEC_DIS)
+			return head.compact ? (const char*)compactDis[i] : (const char*)leastDis[i];
+		return head.compact ? (const char*)compactPath[i] : (const char*)path[i];
+	};
+
+	// each section starts at a multiple of CACHE_LINE, thus tables stay aligned after mapping
+	uint64_t pos = sizeof(head);
+	for (int sec = 0; sec < SEC_NUM; ++sec)
+	{
+		pos = (pos + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+		head.secOff[sec] = pos;
+		head.secLen[sec] = secLen[sec];
+		pos += secLen[sec];
+	}
+
+	file.write((const char*)&head, sizeof(head));
+	pos = sizeof(head);
+	for (int sec = 0; sec < SEC_NUM; ++sec)
+	{
+		for (; pos < head.secOff[sec]; ++pos)
+			file.put(0);
+		if (sec == SEC_DIS || sec == SEC_PATH)
+			for (int i = 0; i < head.stride; ++i)
+				file.write(tableRowData(sec, i), secLen[sec] / head.stride);
+		else
+			file.write((const char*)secData[sec], secLen[sec]);
+		pos += secLen[sec];
+	}
+	if (!file)
+	{
+		cout << "Writing snapshot failed!" << endl;
+		throw valueException(snapSrc);
+	}
+}
+
+template<typename T>
+const T* Metro::snapSection(const MappedFile &snapFile, const SnapshotHeader &head, int sec, size_t count)throw(valueException)
+{
+	if (head.secLen[sec] != count * sizeof(T) || head.secOff[sec] > snapFile.size() || head.secLen[sec] > snapFile.size() - head.secOff[sec])
+	{
+		cout << "Broken snapshot!" << endl;
+		throw valueException(sec);
+	}
+	return (const T*)(snapFile.data() + head.secOff[sec]);
+}
+
+void Metro::loadSnapshot(Network &nw, const string &snapSrc)throw(valueException)
+{
+	shared_ptr<MappedFile> snapFile(new MappedFile);
+	if (!snapFile->open(snapSrc))
+	{
+		cout << "Invalid file directory!" << endl;
+		throw valueException(snapSrc);
+	}
+	const SnapshotHeader &head = *(const SnapshotHeader*)snapFile->data();
+	if (snapFile->size() < sizeof(head) || memcmp(head.magic, SNAPSHOT_MAGIC, sizeof(head.magic)) != 0 || head.version != SNAPSHOT_VERSION)
+	{
+		cout << "Not a snapshot of this version!" << endl;
+		throw valueException(snapSrc);
+	}
+	int n = head.statNum, m = head.edgeNum;
+	if (n < 0 || m < 0 || head.lineNum < 0 || head.lineNum > MAX_LINE_NUM || head.routNum < 0 || head.stride < 0 || head.chEdgeNum < 0 || head.connNum < 0)
+	{
+		cout << "Broken snapshot!" << endl;
+		throw valueException(snapSrc);
+	}
+	// tables are laid out as initTables does, thus every station has a row and a column
+	if (head.stride != 0 && (head.stride < n || head.stride % FLOYD_BLOCK != 0 || (head.compact && n > COMPACT_NONE)))
+	{
+		cout << "Broken snapshot!" << endl;
+		throw valueException(snapSrc);
+	}
+	// numbers read from the file must be ascending or in range before they're used
+	auto checkArray = [&](const int *arr, size_t count, int low, int high, bool ascending) {
+		for (size_t i = 0; i < count; ++i)
+			if (arr[i] < low || arr[i] > high || (ascending && i > 0 && arr[i] < arr[i - 1]))
+			{
+				cout << "Broken snapshot!" << endl;
+				throw valueException(snapSrc);
+			}
+	};
+
+	// names keep their sequence numbers
+	const int *statStart = snapSection<int>(*snapFile, head, SEC_STAT_START, n + 1);
+	checkArray(statStart, n + 1, 0, INT32_MAX, true);
+	const char *statName = snapSection<char>(*snapFile, head, SEC_STAT_NAME, statStart[n]);
+	const int *lineStart = snapSection<int>(*snapFile, head, SEC_LINE_START, head.lineNum + 1);
+	checkArray(lineStart, head.lineNum + 1, 0, INT32_MAX, true);
+	const char *lineName = snapSection<char>(*snapFile, head, SEC_LINE_NAME, lineStart[head.lineNum]);
+	for (int i = 0; i < n; ++i)
+	{
+		nw.statNames.intern(statName + statStart[i], statStart[i + 1] - statStart[i]);
+		Station temp;
+		temp.name = nw.statNames.name(i);
+		temp.isTrans = false;
+		nw.stat.push_back(temp);
+	}
+	for (int i = 0; i < head.lineNum; ++i)
+		nw.lineNames.intern(lineName + lineStart[i], lineStart[i + 1] - lineStart[i]);
+
+	// the CSR graph, and adjacent stations are rebuilt from it
+	const int *offset = snapSection<int>(*snapFile, head, SEC_OFFSET, n + 1);
+	const int *target = snapSection<int>(*snapFile, head, SEC_TARGET, m);
+	const double *weight = snapSection<double>(*snapFile, head, SEC_WEIGHT, m);
+	const LineSet *lines = snapSection<LineSet>(*snapFile, head, SEC_LINES, m);
+	checkArray(offset, n + 1, 0, m, true);
+	checkArray(target, m, 0, n - 1, false);
+	nw.graph.offset.assign(offset, offset + n + 1);
+	nw.graph.target.assign(target, target + m);
+	nw.graph.weight.assign(weight, weight + m);
+	nw.graph.lines.assign(lines, lines + m);
+	for (int i = 0; i < n; ++i)
+		for (int e = nw.graph.offset[i]; e < nw.graph.offset[i + 1]; ++e)
+		{
+			Station::Node tempNode;
+			tempNode.nextStat = nw.graph.target[e];
+			tempNode.path = nw.graph.lines[e];
+			tempNode.distance = nw.graph.weight[e];
+			nw.stat[i].next.push_back(tempNode);
+		}
+
+	// routes, and stations are set again in the same order as reading the txt file
+	const int *routId = snapSection<int>(*snapFile, head, SEC_ROUT_ID, head.routNum);
+	const char *routLoop = snapSection<char>(*snapFile, head, SEC_ROUT_LOOP, head.routNum);
+	const int *routOff = snapSection<int>(*snapFile, head, SEC_ROUT_OFF, head.routNum + 1);
+	checkArray(routId, head.routNum, 0, head.lineNum - 1, false);
+	checkArray(routOff, head.routNum + 1, 0, INT32_MAX, true);
+	const int *routStat = snapSection<int>(*snapFile, head, SEC_ROUT_STAT, routOff[head.routNum]);
+	checkArray(routStat, routOff[head.routNum], 0, n - 1, false);
+	vector<bool> visited(n, false);
+	for (int r = 0; r < head.routNum; ++r)
+	{
+		Route routTemp;
+		routTemp.id = routId[r];
+		routTemp.name = nw.lineNames.name(routTemp.id);
+		routTemp.isLoop = routLoop[r] != 0;
+		routTemp.myStat.assign(routStat + routOff[r], routStat + routOff[r + 1]);
+		for (int i = 0; i < (int)routTemp.myStat.size(); ++i)
+		{
+			int num = routTemp.myStat[i];
+			nw.stat[num].isTrans = nw.stat[num].isTrans || visited[num];
+			visited[num] = true;
+			nw.setDigName(nw.stat[num], routTemp.name, i + 1);
+		}
+		nw.rout.push_back(routTemp);
+	}
+
+	// the hierarchy is small, thus it's copied and its upward edges are rebuilt
+	if (head.chEdgeNum > 0)
+	{
+		const int *rank = snapSection<int>(*snapFile, head, SEC_CH_RANK, n);
+		checkArray(rank, n, 0, n - 1, false);
+		const HierarchyEdge *edges = snapSection<HierarchyEdge>(*snapFile, head, SEC_CH_EDGE, head.chEdgeNum);
+		for (int e = 0; e < head.chEdgeNum; ++e)
+			if (edges[e].from < 0 || edges[e].from >= n || edges[e].to < 0 || edges[e].to >= n
+				|| edges[e].first < -1 || edges[e].first >= e || edges[e].second < -1 || edges[e].second >= e)
+			{
+				cout << "Broken snapshot!" << endl;
+				throw valueException(snapSrc);
+			}
+		shared_ptr<Hierarchy> ch = make_shared<Hierarchy>();
+		ch->rank.assign(rank, rank + n);
+		ch->edges.assign(edges, edges + head.chEdgeNum);
+		buildHierarchyGraph(*ch);
+		hierarchy = ch;
+	}
+
+	// connections are checked and copied, since timetables of routes aren't stored
+	const Connection *conns = snapSection<Connection>(*snapFile, head, SEC_CONNECTION, head.connNum);
+	for (int c = 0; c < head.connNum; ++c)
+		if (conns[c].from < 0 || conns[c].from >= n || conns[c].to < 0 || conns[c].to >= n || conns[c].line < 0 || conns[c].line >= head.lineNum
+			|| conns[c].edge < nw.graph.offset[conns[c].from] || conns[c].edge >= nw.graph.offset[conns[c].from + 1] || nw.graph.target[conns[c].edge] != conns[c].to
+			|| conns[c].arrival < conns[c].departure || (c > 0 && conns[c].departure < conns[c - 1].departure))
+		{
+			cout << "Broken snapshot!" << endl;
+			throw valueException(snapSrc);
+		}
+	nw.connections.assign(conns, conns + head.connNum);
+
+	// tables are used directly from the mapped file, only row pointers are set, and every row keeps the file mapped
+	tableAlg = head.tableAlg;
+	int rows = head.stride;
+	if (rows == 0)
+		return;
+	shared_ptr<Tables> next = make_shared<Tables>();
+	next->stride = rows;
+	next->owner.assign(rows, snapFile);
+	size_t size = (size_t)rows * rows;
+	if (head.compact)
+	{
+		uint32_t *dis = (uint32_t*)snapSection<uint32_t>(*snapFile, head, SEC_DIS, size);
+		uint16_t *prev = (uint16_t*)snapSection<uint16_t>(*snapFile, head, SEC_PATH, size);
+		// routes are walked back by the previous stations, thus they must be stations or none
+		for (int i = 0; i < n; ++i)
+			for (int j = 0; j < n; ++j)
+				if (prev[(size_t)i * rows + j] >= n && prev[(size_t)i * rows + j] != COMPACT_NONE)
+				{
+					cout << "Broken snapshot!" << endl;
+					throw valueException(snapSrc);
+				}
+		for (int i = 0; i < rows; ++i)
+		{
+			next->compactDis.push_back(dis + (size_t)i * rows);
+			next->compactPrev.push_back(prev + (size_t)i * rows);
+		}
+	}
+	else
+	{
+		double *dis = (double*)snapSection<double>(*snapFile, head, SEC_DIS, size);
+		int *prev = (int*)snapSection<int>(*snapFile, head, SEC_PATH, size);
+		for (int i = 0; i < n; ++i)
+			checkArray(prev + (size_t)i * rows, n, -1, n - 1, false);
+		for (int i = 0; i < rows; ++i)
+		{
+			next->dis.push_back(dis + (size_t)i * rows);
+			next->prev.push_back(prev + (size_t)i * rows);
+		}
+	}
+	useTables(next);
+}
+
+// Floyd algorithm to calculate the shortest path from all stations to all stations
+// time cost is O(n^3)
+/*
+* The tables are cut into tiles of FLOYD_BLOCK * FLOYD_BLOCK, so that the tiles in use stay in cache.
+* In round kb, stations in the kb-th block are used as relay stations:
+* 1. the diagonal tile (kb, kb) is relaxed by itself;
+* 2. tiles in row kb and col kb only depend on the diagonal tile, they're relaxed in parallel;
+* 3. all the other tiles only depend on tiles in row kb and col kb, they're relaxed in parallel at last.
+* Relay stations of every pair are still tried from small to large, as in the original algorithm.
+* path[i][j] is the previous station of j along the shortest path from i, it's taken from path[k][j] when relaxed through k.
+*/
+void Metro::Floyd(bool compact)
+{
+	METRIC_PHASE(metrics, TABLES);
+	initTables(compact);
+	tableAlg = 'f';
+	int tiles = stride / FLOYD_BLOCK;
+	for (int kb = 0; kb < tiles; ++kb)
+	{
+		floydTile(kb, kb, kb);
+		// the other numbers of tiles skip kb
+		parallelFor(2 * (tiles - 1), [&](int t) {
+			int other = t % (tiles - 1);
+			other += other >= kb;
+			if (t < tiles - 1)
+				floydTile(kb, kb, other);
+			else
+				floydTile(kb, other, kb);
+		});
+		parallelFor((tiles - 1) * (tiles - 1), [&](int t) {
+			int ib = t / (tiles - 1), jb = t % (tiles - 1);
+			ib += ib >= kb;
+			jb += jb >= kb;
+			floydTile(kb, ib, jb);
+		});
+	}
+}
+
+// relax tile (ib, jb) through the stations in block kb
+void Metro::floydTile(int kb, int ib, int jb)
+{
+	if (compactDis != nullptr)
+		floydTile(compactDis, compactPath, COMPACT_INF, kb, ib, jb);
+	else
+		floydTile(leastDis, path, (double)INF, kb, ib, jb);
+}
+
+template<typename Dis, typename Prev>
+void Metro::floydTile(Dis *const *dis, Prev *const *prev, Dis inf, int kb, int ib, int jb)
+{
+	int kEnd = (kb + 1) * FLOYD_BLOCK, iEnd = (ib + 1) * FLOYD_BLOCK, jBegin = jb * FLOYD_BLOCK;
+	for (int k = kb * FLOYD_BLOCK; k < kEnd; ++k)
+		for (int i = ib * FLOYD_BLOCK; i < iEnd; ++i)
+			// nothing can be relaxed through a station that can't be arrived at
+			if (dis[i][k] != inf)
+				minPlusRow(dis[i] + jBegin, prev[i] + jBegin, dis[k] + jBegin, prev[k] + jBegin, dis[i][k]);
+}
+
+// disI[j] = min(disI[j], disIK + disK[j]), and pathI[j] = pathK[j] when disI[j] is relaxed
+// distances are compared with SIMD instructions, and paths are written only for relaxed elements
+void Metro::minPlusRow(double *disI, int *pathI, const double *disK, const int *pathK, double disIK)
+{
+#if defined(__AVX__)
+	__m256d ik = _mm256_set1_pd(disIK);
+	for (int j = 0; j < FLOYD_BLOCK; j += 4)
+	{
+		__m256d sum = _mm256_add_pd(ik, _mm256_load_pd(disK + j)), cur = _mm256_load_pd(disI + j);
+		int mask = _mm256_movemask_pd(_mm256_cmp_pd(sum, cur, _CMP_LT_OQ));
+		if (mask == 0)
+			continue;
+		_mm256_store_pd(disI + j, _mm256_min_pd(sum, cur));
+		for (int bit = 0; bit < 4; ++bit)
+			if (mask >> bit & 1)
+				pathI[j + bit] = pathK[j + bit];
+	}
+#elif defined(__SSE2__) || defined(_M_X64)
+	__m128d ik = _mm_set1_pd(disIK);
+	for (int j = 0; j < FLOYD_BLOCK; j += 2)
+	{
+		__m128d sum = _mm_add_pd(ik, _mm_load_pd(disK + j)), cur = _mm_load_pd(disI + j);
+		int mask = _mm_movemask_pd(_mm_cmplt_pd(sum, cur));
+		if (mask == 0)
+			continue;
+		_mm_store_pd(disI + j, _mm_min_pd(sum, cur));
+		if (mask & 1)
+			pathI[j] = pathK[j];
+		if (mask & 2)
+			pathI[j + 1] = pathK[j + 1];
+	}
+#else
+	for (int j = 0; j < FLOYD_BLOCK; ++j)
+		if (disIK + disK[j] < disI[j])
+		{
+			disI[j] = disIK + disK[j];
+			pathI[j] = pathK[j];
+		}
+#endif
+}
+
+// the same on compact tables, entries are below 2^30 and so are compared as signed integers, which SSE2 has
+void Metro::minPlusRow(uint32_t *disI, uint16_t *pathI, const uint32_t *disK, const uint16_t *pathK, uint32_t disIK)
+{
+#if defined(__AVX2__)
+	__m256i ik = _mm256_set1_epi32(disIK);
+	for (int j = 0; j < FLOYD_BLOCK; j += 8)
+	{
+		__m256i sum = _mm256_add_epi32(ik, _mm256_load_si256((const __m256i*)(disK + j))), cur = _mm256_load_si256((const __m256i*)(disI + j));
+		int mask = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(cur, sum)));
+		if (mask == 0)
+			continue;
+		_mm256_store_si256((__m256i*)(disI + j), _mm256_min_epi32(sum, cur));
+		for (int bit = 0; bit < 8; ++bit)
+			if (mask >> bit & 1)
+				pathI[j + bit] = pathK[j + bit];
+	}
+#elif defined(__SSE2__) || defined(_M_X64)
+	__m128i ik = _mm_set1_epi32(disIK);
+	for (int j = 0; j < FLOYD_BLOCK; j += 4)
+	{
+		__m128i sum = _mm_add_epi32(ik, _mm_load_si128((const __m128i*)(disK + j))), cur = _mm_load_si128((const __m128i*)(disI + j));
+		__m128i less = _mm_cmpgt_epi32(cur, sum);
+		int mask = _mm_movemask_ps(_mm_castsi128_ps(less));
+		if (mask == 0)
+			continue;
+		_mm_store_si128((__m128i*)(disI + j), _mm_or_si128(_mm_and_si128(less, sum), _mm_andnot_si128(less, cur)));
+		for (int bit = 0; bit < 4; ++bit)
+			if (mask >> bit & 1)
+				pathI[j + bit] = pathK[j + bit];
+	}
+#else
+	for (int j = 0; j < FLOYD_BLOCK; ++j)
+		if (disIK + disK[j] < disI[j])
+		{
+			disI[j] = disIK + disK[j];
+			pathI[j] = pathK[j];
+		}
+#endif
+}
+
+// push a pair into the heap, the children of data[i] are data[4 * i + 1] ... data[4 * i + 4]
+void Metro::MinHeap::push(double key, int num)
+{
+	int i = data.size();
+	data.push_back(Elem());
+	// move parents down until the right position is found
+	while (i > 0 && data[(i - 1) / 4].key > key)
+	{
+		data[i] = data[(i - 1) / 4];
+		i = (i - 1) / 4;
+	}
+	data[i].key = key;
+	data[i].num = num;
+}
+
+// remove the pair with the minimum distance
+void Metro::MinHeap::pop()
+{
+	Elem last = data.back();
+	data.pop_back();
+	int size = data.size();
+	if (size == 0)
+		return;
+
+	// move the smallest child up until the last element fits
+	int i = 0;
+	while (4 * i + 1 < size)
+	{
+		int child = 4 * i + 1, end = min(child + 4, size), minChild = child;
+		for (++child; child < end; ++child)
+			if (data[child].key < data[minChild].key)
+				minChild = child;
+		if (data[minChild].key >= last.key)
+			break;
+		data[i] = data[minChild];
+		i = minChild;
+	}
+	data[i] = last;
+}
+
+Metro::QueryScratch& Metro::threadScratch()
+{
+	static thread_local QueryScratch scratch;
+	return scratch;
+}
+
+void Metro::QueryScratch::reset(int n)
+{
+	if ((int)stamp.size() != n)
+	{
+		dis.assign(n, INF);
+		prev.assign(n, -1);
+		stamp.assign(n, 0);
+		METRIC_ADD(allocations, 3);
+	}
+	// curStamp never goes back, since backStamp of an earlier search may be kept when only stamp is resized
+	// when the stamp overflows, clear all stamps once
+	if (++curStamp == 0)
+	{
+		fill(stamp.begin(), stamp.end(), 0);
+		fill(backStamp.begin(), backStamp.end(), 0);
+		curStamp = 1;
+	}
+	heap.clear();
+}
+
+void Metro::QueryScratch::resetBoth(int n)
+{
+	if ((int)backStamp.size() != n)
+	{
+		backDis.assign(n, INF);
+		next.assign(n, -1);
+		backStamp.assign(n, 0);
+		METRIC_ADD(allocations, 3);
+	}
+	reset(n);
+	backHeap.clear();
+}
+
+// Dijkstra algorithm with a 4-ary heap, only adjacent stations of the settled one are relaxed
+// time cost is O(m log n) and it stops as soon as the destination is settled
+double Metro::heapDijkstra(const Graph &graph, const vector<double> &weight, int src, int des, QueryScratch &scratch)const
+{
+	scratch.reset(graph.size());
+	scratch.setDis(src, 0, -1);
+	scratch.heap.push(0, src);
+
+	while (!scratch.heap.empty())
+	{
+		MinHeap::Elem top = scratch.heap.top();
+		scratch.heap.pop();
+		// skip outdated pairs
+		if (top.key > scratch.getDis(top.num))
+			continue;
+		// the destination is settled
+		if (top.num == des)
+			break;
+		METRIC_ADD(scratch.settled, 1);
+		METRIC_ADD(scratch.relaxed, graph.offset[top.num + 1] - graph.offset[top.num]);
+
+		for (int e = graph.offset[top.num]; e < graph.offset[top.num + 1]; ++e)
+		{
+			int adj = graph.target[e];
+			double dis = top.key + weight[e];
+			if (dis < scratch.getDis(adj))
+			{
+				scratch.setDis(adj, dis, top.num);
+				scratch.heap.push(dis, adj);
+			}
+		}
+	}
+	return des < 0 ? 0 : scratch.getDis(des);
+}
+
+// time cost is O(n m log n), much less than Floyd algorithm on a sparse network, and the sources are shared by all cores
+// path[src][i] is the previous station of i, the same as Floyd algorithm
+void Metro::allPairsDijkstra(bool compact)
+{
+	METRIC_PHASE(metrics, TABLES);
+	initTables(compact);
+	tableAlg = 'p';
+	int n = net->graph.size();
+	parallelFor(n, [&](int src) {
+		// every worker thread has its own heap and distance buffers
+		tableRow(src, threadScratch());
+	});
+}
+
+void Metro::tableRow(int src, QueryScratch &scratch)
+{
+	heapDijkstra(src, -1, scratch);
+	for (int i = 0; i < net->graph.size(); ++i)
+	{
+		double dis = scratch.getDis(i);
+		setTableEntry(src, i, dis, dis == INF ? -1 : (i == src ? src : scratch.prev[i]));
+	}
+}
+
+int Metro::edgeSource(int e)const
+{
+	return upper_bound(net->graph.offset.begin(), net->graph.offset.end(), e) - net->graph.offset.begin() - 1;
+}
+
+bool Metro::setStationClosed(const string &name, bool closed)
+{
+	int num = searchStatNum(name);
+	if (num < 0)
+		return false;
+	Changes &next = editChanges();
+	if (next.closedStat.empty())
+		next.closedStat.assign(net->graph.size(), false);
+	next.closedStat[num] = closed;
+
+	// edges leaving the station, then those entering it, found by the reverse graph
+	vector<int> edges;
+	for (int e = net->graph.offset[num]; e < net->graph.offset[num + 1]; ++e)
+		edges.push_back(e);
+	for (int r = net->reverseGraph.offset[num]; r < net->reverseGraph.offset[num + 1]; ++r)
+		if (net->reverseGraph.target[r] != num)
+			edges.push_back(net->graph.findEdge(net->reverseGraph.target[r], num));
+	applyChange(next, edges);
+	return true;
+}
+
+bool Metro::setSegmentClosed(const string &from, const string &to, bool closed)
+{
+	int fromNum = searchStatNum(from), toNum = searchStatNum(to);
+	int e = fromNum < 0 || toNum < 0 ? -1 : net->graph.findEdge(fromNum, toNum);
+	if (e < 0)
+		return false;
+	Changes &next = editChanges();
+	if (next.closedEdge.empty())
+		next.closedEdge.assign(net->graph.target.size(), false);
+	next.closedEdge[e] = closed;
+	applyChange(next, vector<int>(1, e));
+	return true;
+}
+
+bool Metro::setSegmentWeight(const string &from, const string &to, double weight)
+{
+	int fromNum = searchStatNum(from), toNum = searchStatNum(to);
+	int e = fromNum < 0 || toNum < 0 ? -1 : net->graph.findEdge(fromNum, toNum);
+	if (e < 0 || !(weight > 0) || weight == INF)
+		return false;
+	Changes &next = editChanges();
+	if (next.openWeight.empty())
+		next.openWeight = net->graph.weight;
+	next.openWeight[e] = weight;
+	applyChange(next, vector<int>(1, e));
+	return true;
+}
+
+Metro::Network& Metro::editNetwork()
+{
+	if (net.use_count() > 1)
+		net = make_shared<Network>(*net);
+	return const_cast<Network&>(*net);
+}
+
+// it costs O(edges + stops) to copy, the network itself is never copied
+Metro::Changes& Metro::editChanges()
+{
+	shared_ptr<Changes> next;
+	if (changes)
+		next = make_shared<Changes>(*changes);
+	else
+	{
+		next = make_shared<Changes>();
+		next->weight = net->graph.weight;
+		next->reverseWeight = net->reverseGraph.weight;
+		next->stateWeight = net->stateGraph.weight;
+		next->patternDis = net->patternDis;
+		next->patternCut = net->patternCut;
+	}
+	changes = next;
+	return *next;
+}
+
+/*
+* Closures and distances never change the topology, thus the network is kept, and what depends on weights is repaired rather than built again:
+* 1. Weights of the segment in the graph, the reverse graph and the state graph are set in the changes, and patterns through it are walked again.
+* 2. The tables are repaired incrementally (see repairTables), compact ones are widened first if they can't hold the new distance.
+* 3. Trees cached by Dijkstra are dropped.
+* 4. The hierarchy and the skeleton can't be repaired, since a change may need shortcuts or chains which weren't kept.
+*    They're dropped instead, searches go by bidirectional Dijkstra until MetroRegistry has built them again in the background.
+*/
+void Metro::applyChange(Changes &next, const vector<int> &edges)
+{
+	METRIC_PHASE(metrics, REPAIR);
+	vector<int> increased, decreased, patterns;
+	for (vector<int>::const_iterator iter = edges.begin(); iter != edges.end(); ++iter)
+	{
+		int e = *iter, from = edgeSource(e), to = net->graph.target[e];
+		bool closed = (!next.closedEdge.empty() && next.closedEdge[e]) || (!next.closedStat.empty() && (next.closedStat[from] || next.closedStat[to]));
+		double weight = closed ? INF : next.openWeight.empty() ? net->graph.weight[e] : next.openWeight[e];
+		if (weight > next.weight[e])
+			increased.push_back(e);
+		else if (weight < next.weight[e])
+			decreased.push_back(e);
+		next.weight[e] = weight;
+
+		// the reverse graph and patterns are always built by load
+		next.reverseWeight[net->reverseGraph.findEdge(to, from)] = weight;
+		for (int k = net->edgeStopOff[e]; k < net->edgeStopOff[e + 1]; ++k)
+			patterns.push_back(net->stopPattern[net->edgeStop[k]]);
+		// state (from, line) has one edge to state (to, line) for each line of the segment
+		if (!net->stateStat.empty())
+			for (int s = net->statStateOff[from]; s < net->statStateOff[from + 1]; ++s)
+				for (int k = net->stateGraph.offset[s]; k < net->stateGraph.offset[s + 1]; ++k)
+					if (net->stateStat[net->stateGraph.target[k]] == to)
+						next.stateWeight[k] = weight;
+	}
+
+	if (hasTables())
+		repairTables(increased, decreased);
+	sort(patterns.begin(), patterns.end());
+	patterns.erase(unique(patterns.begin(), patterns.end()), patterns.end());
+	for (vector<int>::iterator iter = patterns.begin(); iter != patterns.end(); ++iter)
+		net->patternWeights(*iter, next.weight, next.patternDis, next.patternCut);
+	treeCache.clear();
+	targetCache.clear();
+	hierarchy.reset();
+	skeleton.reset();
+}
+
+void Metro::rebuildIndex()
+{
+	if (alg == 'c' && !hierarchy)
+		contractHierarchy();
+	else if (alg == 's' && !skeleton)
+		buildSkeleton();
+}
+
+/*
+* 1. When edge u -> v becomes longer, only sources whose shortest path trees use it are affected, that is, path[s][v] = u.
+*    Their rows are computed again by Dijkstra, the other rows are still the shortest since their trees keep the same length.
+* 2. When edge u -> v becomes shorter, a shortest path uses it at most once, thus dis[s][t] = min(dis[s][t], dis[s][u] + w + dis[v][t]).
+*    Row v and column u never change in this step, so all rows are relaxed in place and in parallel, edge by edge.
+* It costs O(n^2) for each shorter edge and Dijkstra for each affected source, instead of O(n^3) for Floyd algorithm.
+* The tables are shared with the Metro this one is copied from, thus a row is copied (or allocated, when it's computed again)
+* the first time it's written, and the rows which don't change stay shared.
+*/
+void Metro::repairTables(const vector<int> &increased, const vector<int> &decreased)
+{
+	int n = net->graph.size();
+	// rows which are new in this change, all of them when the tables are widened
+	vector<char> own(n, false);
+	if (compactDis != nullptr && !compactFits())
+	{
+		widenTables();
+		own.assign(n, true);
+	}
+	shared_ptr<Tables> next = make_shared<Tables>(*tables);
+	useTables(next);
+
+	vector<int> from(increased.size()), rows;
+	for (int k = 0; k < (int)increased.size(); ++k)
+		from[k] = edgeSource(increased[k]);
+	for (int s = 0; s < n; ++s)
+		for (int k = 0; k < (int)increased.size(); ++k)
+			if (tablePrev(s, net->graph.target[increased[k]]) == from[k])
+			{
+				rows.push_back(s);
+				break;
+			}
+	parallelFor(rows.size(), [&](int r) {
+		if (!own[rows[r]])
+			detachRow(*next, rows[r], false);
+		own[rows[r]] = true;
+		tableRow(rows[r], threadScratch());
+	});
+
+	for (vector<int>::const_iterator iter = decreased.begin(); iter != decreased.end(); ++iter)
+	{
+		int u = edgeSource(*iter), v = net->graph.target[*iter];
+		double w = edgeWeight()[*iter];
+		parallelFor(n, [&](int s) {
+			double viaEdge = tableDis(s, u) + w;
+			if (viaEdge == INF)
+				return;
+			for (int t = 0; t < n; ++t)
+				if (viaEdge + tableDis(v, t) < tableDis(s, t))
+				{
+					if (!own[s])
+						detachRow(*next, s, true);
+					own[s] = true;
+					setTableEntry(s, t, viaEdge + tableDis(v, t), t == v ? u : tablePrev(v, t));
+				}
+		});
+	}
+}
+
+// rows are only replaced in the tables being repaired, which no other Metro can see, and each row by one task
+// a row detached by an earlier change is written in place, if no other tables share it any more
+void Metro::detachRow(Tables &next, int s, bool keep)
+{
+	if (next.owner[s].use_count() == 1)
+		return;
+	// the shared row is kept until it's copied
+	shared_ptr<const void> shared = next.owner[s];
+	if (next.compact())
+	{
+		uint32_t *dis = (uint32_t*)alignedAlloc(sizeof(uint32_t) * stride);
+		uint16_t *prev = (uint16_t*)alignedAlloc(sizeof(uint16_t) * stride);
+		next.owner[s] = make_shared<TableBlocks>(dis, prev);
+		if (keep)
+		{
+			copy(next.compactDis[s], next.compactDis[s] + stride, dis);
+			copy(next.compactPrev[s], next.compactPrev[s] + stride, prev);
+		}
+		else
+		{
+			fill(dis, dis + stride, COMPACT_INF);
+			fill(prev, prev + stride, COMPACT_NONE);
+		}
+		next.compactDis[s] = dis;
+		next.compactPrev[s] = prev;
+	}
+	else
+	{
+		double *dis = (double*)alignedAlloc(sizeof(double) * stride);
+		int *prev = (int*)alignedAlloc(sizeof(int) * stride);
+		next.owner[s] = make_shared<TableBlocks>(dis, prev);
+		if (keep)
+		{
+			copy(next.dis[s], next.dis[s] + stride, dis);
+			copy(next.prev[s], next.prev[s] + stride, prev);
+		}
+		else
+		{
+			fill(dis, dis + stride, INF);
+			fill(prev, prev + stride, -1);
+		}
+		next.dis[s] = dis;
+		next.prev[s] = prev;
+	}
+	METRIC_COUNT(metrics, ALLOCATIONS, 2);
+}
+
+// it costs O(n^2) to convert the entries, into new blocks since the compact ones may be shared
+void Metro::widenTables()
+{
+	shared_ptr<Tables> next = newTables(stride, false);
+	for (int i = 0; i < stride; ++i)
+		for (int j = 0; j < stride; ++j)
+		{
+			next->dis[i][j] = compactDis[i][j] == COMPACT_INF ? INF : compactDis[i][j];
+			next->prev[i][j] = compactPath[i][j] == COMPACT_NONE ? -1 : compactPath[i][j];
+		}
+	useTables(next);
+}
+
+void Metro::Network::buildReverseGraph()
+{
+	int n = graph.size();
+	reverseGraph.offset.assign(n + 1, 0);
+	for (int e = 0; e < graph.offset[n]; ++e)
+		++reverseGraph.offset[graph.target[e] + 1];
+	for (int i = 0; i < n; ++i)
+		reverseGraph.offset[i + 1] += reverseGraph.offset[i];
+
+	reverseGraph.target.resize(graph.offset[n]);
+	reverseGraph.weight.resize(graph.offset[n]);
+	vector<int> pos(reverseGraph.offset.begin(), reverseGraph.offset.end() - 1);
+	for (int i = 0; i < n; ++i)
+		for (int e = graph.offset[i]; e < graph.offset[i + 1]; ++e)
+		{
+			int r = pos[graph.target[e]]++;
+			reverseGraph.target[r] = i;
+			reverseGraph.weight[r] = graph.weight[e];
+		}
+}
+
+/*
+* The direction with the smaller heap top is expanded in each step.
+* Whenever a station is reached by both directions, the joined path is a candidate, and the best one is kept.
+* Once the sum of the two heap tops is no less than the best candidate, no shorter path can exist, so it stops.
+* Only stations around the source and the destination are settled, instead of the whole network.
+*/
+int Metro::bidirectionalDijkstra(int src, int des, QueryScratch &scratch)const
+{
+	scratch.resetBoth(net->graph.size());
+	scratch.setDis(src, 0, -1);
+	scratch.heap.push(0, src);
+	scratch.setBackDis(des, 0, -1);
+	scratch.backHeap.push(0, des);
+
+	double best = src == des ? 0 : INF;
+	int meet = src == des ? src : -1;
+	while (!scratch.heap.empty() && !scratch.backHeap.empty()
+		&& scratch.heap.top().key + scratch.backHeap.top().key < best)
+	{
+		bool forward = scratch.heap.top().key <= scratch.backHeap.top().key;
+		MinHeap &heap = forward ? scratch.heap : scratch.backHeap;
+		const Graph &g = forward ? net->graph : net->reverseGraph;
+		const vector<double> &weight = forward ? edgeWeight() : reverseWeight();
+		MinHeap::Elem top = heap.top();
+		heap.pop();
+		// skip outdated pairs
+		if (top.key > (forward ? scratch.getDis(top.num) : scratch.getBackDis(top.num)))
+			continue;
+		METRIC_ADD(scratch.settled, 1);
+		METRIC_ADD(scratch.relaxed, g.offset[top.num + 1] - g.offset[top.num]);
+
+		for (int e = g.offset[top.num]; e < g.offset[top.num + 1]; ++e)
+		{
+			int adj = g.target[e];
+			double dis = top.key + weight[e];
+			if (dis >= (forward ? scratch.getDis(adj) : scratch.getBackDis(adj)))
+				continue;
+			if (forward)
+				scratch.setDis(adj, dis, top.num);
+			else
+				scratch.setBackDis(adj, dis, top.num);
+			heap.push(dis, adj);
+
+			// the other direction has reached adj as well
+			double joined = dis + (forward ? scratch.getBackDis(adj) : scratch.getDis(adj));
+			if (joined < best)
+			{
+				best = joined;
+				meet = adj;
+			}
+		}
+	}
+	return meet;
+}
+
+/*
+* Stations are contracted in the order of priority: shortcuts added - edges removed + contracted neighbours.
+* Priorities are updated lazily, a station is contracted only when its new priority is still the smallest.
+* A witness search is a Dijkstra from an in-neighbour avoiding the station, limited by distance and WITNESS_LIMIT.
+* When it's stopped by the limit, a shortcut may be added needlessly, which costs some speed but never correctness.
+*/
+void Metro::contractHierarchy()
+{
+	METRIC_PHASE(metrics, HIERARCHY);
+	struct Arc
+	{
+		int adj;      // neighbour station
+		double weight;
+		int edge;     // number of the hierarchy edge
+	};
+	int n = net->graph.size();
+	const vector<double> &weight = edgeWeight();
+	// a hierarchy never changes once it is shared, thus a new one is built
+	shared_ptr<Hierarchy> next = make_shared<Hierarchy>();
+	Hierarchy &ch = *next;
+	ch.rank.assign(n, -1);
+	vector<vector<Arc>> out(n), in(n);
+	for (int i = 0; i < n; ++i)
+		for (int e = net->graph.offset[i]; e < net->graph.offset[i + 1]; ++e)
+		{
+			HierarchyEdge edge = { i, net->graph.target[e], weight[e], -1, -1 };
+			Arc outArc = { edge.to, edge.weight, (int)ch.edges.size() }, inArc = { i, edge.weight, outArc.edge };
+			out[i].push_back(outArc);
+			in[edge.to].push_back(inArc);
+			ch.edges.push_back(edge);
+		}
+
+	vector<int> contractedNeighbours(n, 0);
+	QueryScratch scratch;
+
+	// distances from src to stations around it without passing station "avoid"
+	auto witness = [&](int src, int avoid, double maxDis) {
+		scratch.reset(n);
+		scratch.setDis(src, 0, -1);
+		scratch.heap.push(0, src);
+		for (int settled = 0; !scratch.heap.empty() && settled < WITNESS_LIMIT; ++settled)
+		{
+			MinHeap::Elem top = scratch.heap.top();
+			scratch.heap.pop();
+			if (top.key > scratch.getDis(top.num))
+				continue;
+			if (top.key > maxDis)
+				break;
+			for (vector<Arc>::const_iterator iter = out[top.num].begin(); iter != out[top.num].end(); ++iter)
+			{
+				double dis = top.key + (*iter).weight;
+				if ((*iter).adj != avoid && dis < scratch.getDis((*iter).adj))
+				{
+					scratch.setDis((*iter).adj, dis, top.num);
+					scratch.heap.push(dis, (*iter).adj);
+				}
+			}
+		}
+	};
+	// count (or add) the shortcuts needed when station v is contracted
+	auto contract = [&](int v, bool simulate) {
+		int added = 0;
+		double maxOut = 0;
+		for (vector<Arc>::const_iterator iter = out[v].begin(); iter != out[v].end(); ++iter)
+			maxOut = max(maxOut, (*iter).weight);
+		for (int a = 0; a < (int)in[v].size(); ++a)
+		{
+			Arc from = in[v][a];
+			witness(from.adj, v, from.weight + maxOut);
+			for (int b = 0; b < (int)out[v].size(); ++b)
+			{
+				Arc to = out[v][b];
+				double dis = from.weight + to.weight;
+				if (to.adj == from.adj || scratch.getDis(to.adj) <= dis)
+					continue;
+				++added;
+				if (simulate)
+					continue;
+
+				// the witness search has relaxed any existing edge from.adj -> to.adj, thus the shortcut is shorter and replaces it
+				HierarchyEdge edge = { from.adj, to.adj, dis, from.edge, to.edge };
+				Arc outArc = { to.adj, dis, (int)ch.edges.size() }, inArc = { from.adj, dis, outArc.edge };
+				ch.edges.push_back(edge);
+				vector<Arc> &outList = out[from.adj], &inList = in[to.adj];
+				vector<Arc>::iterator oldOut = find_if(outList.begin(), outList.end(), [&](const Arc &x) {return x.adj == to.adj; });
+				vector<Arc>::iterator oldIn = find_if(inList.begin(), inList.end(), [&](const Arc &x) {return x.adj == from.adj; });
+				if (oldOut == outList.end())
+					outList.push_back(outArc);
+				else
+					*oldOut = outArc;
+				if (oldIn == inList.end())
+					inList.push_back(inArc);
+				else
+					*oldIn = inArc;
+			}
+		}
+		return added;
+	};
+	auto priority = [&](int v) {
+		return contract(v, true) - (int)(in[v].size() + out[v].size()) + contractedNeighbours[v];
+	};
+
+	MinHeap order;
+	for (int i = 0; i < n; ++i)
+		order.push(priority(i), i);
+	for (int rank = 0; !order.empty();)
+	{
+		int v = order.top().num;
+		order.pop();
+		if (ch.rank[v] >= 0)
+			continue;
+		int p = priority(v);
+		if (!order.empty() && p > order.top().key)
+		{
+			order.push(p, v);
+			continue;
+		}
+
+		contract(v, false);
+		ch.rank[v] = rank++;
+		// v is removed from the remaining graph
+		for (vector<Arc>::const_iterator iter = out[v].begin(); iter != out[v].end(); ++iter)
+		{
+			vector<Arc> &list = in[(*iter).adj];
+			list.erase(remove_if(list.begin(), list.end(), [&](const Arc &x) {return x.adj == v; }), list.end());
+			++contractedNeighbours[(*iter).adj];
+		}
+		for (vector<Arc>::const_iterator iter = in[v].begin(); iter != in[v].end(); ++iter)
+		{
+			vector<Arc> &list = out[(*iter).adj];
+			list.erase(remove_if(list.begin(), list.end(), [&](const Arc &x) {return x.adj == v; }), list.end());
+			++contractedNeighbours[(*iter).adj];
+		}
+		vector<Arc>().swap(out[v]);
+		vector<Arc>().swap(in[v]);
+	}
+	buildHierarchyGraph(ch);
+	hierarchy = next;
+	tableAlg = 'c';
+}
+
+// an edge goes up from its lower ranked end, it's used by the forward search at "from" or the backward search at "to"
+void Metro::buildHierarchyGraph(Hierarchy &ch)
+{
+	int n = ch.rank.size();
+	ch.upOff.assign(n + 1, 0);
+	ch.downOff.assign(n + 1, 0);
+	for (vector<HierarchyEdge>::const_iterator iter = ch.edges.begin(); iter != ch.edges.end(); ++iter)
+		if (ch.rank[(*iter).from] < ch.rank[(*iter).to])
+			++ch.upOff[(*iter).from + 1];
+		else
+			++ch.downOff[(*iter).to + 1];
+	for (int i = 0; i < n; ++i)
+	{
+		ch.upOff[i + 1] += ch.upOff[i];
+		ch.downOff[i + 1] += ch.downOff[i];
+	}
+
+	ch.up.resize(ch.upOff[n]);
+	ch.down.resize(ch.downOff[n]);
+	vector<int> upPos(ch.upOff.begin(), ch.upOff.end() - 1), downPos(ch.downOff.begin(), ch.downOff.end() - 1);
+	for (int e = 0; e < (int)ch.edges.size(); ++e)
+	{
+		const HierarchyEdge &edge = ch.edges[e];
+		if (ch.rank[edge.from] < ch.rank[edge.to])
+			ch.up[upPos[edge.from]++] = e;
+		else
+			ch.down[downPos[edge.to]++] = e;
+	}
+}
+
+// a direction stops once its heap top is no less than the best joined distance, the query ends when both stop
+int Metro::hierarchyDijkstra(int src, int des, QueryScratch &scratch)const
+{
+	scratch.resetBoth(hierarchy->rank.size());
+	scratch.setDis(src, 0, -1);
+	scratch.heap.push(0, src);
+	scratch.setBackDis(des, 0, -1);
+	scratch.backHeap.push(0, des);
+
+	double best = INF;
+	int meet = -1;
+	while (!scratch.heap.empty() || !scratch.backHeap.empty())
+	{
+		bool forward = scratch.backHeap.empty() || (!scratch.heap.empty() && scratch.heap.top().key <= scratch.backHeap.top().key);
+		MinHeap &heap = forward ? scratch.heap : scratch.backHeap;
+		MinHeap::Elem top = heap.top();
+		heap.pop();
+		if (top.key >= best)
+		{
+			heap.clear();
+			continue;
+		}
+		// skip outdated pairs
+		if (top.key > (forward ? scratch.getDis(top.num) : scratch.getBackDis(top.num)))
+			continue;
+
+		double joined = top.key + (forward ? scratch.getBackDis(top.num) : scratch.getDis(top.num));
+		if (joined < best)
+		{
+			best = joined;
+			meet = top.num;
+		}
+
+		const vector<int> &off = forward ? hierarchy->upOff : hierarchy->downOff, &edges = forward ? hierarchy->up : hierarchy->down;
+		METRIC_ADD(scratch.settled, 1);
+		METRIC_ADD(scratch.relaxed, off[top.num + 1] - off[top.num]);
+		for (int k = off[top.num]; k < off[top.num + 1]; ++k)
+		{
+			const HierarchyEdge &edge = hierarchy->edges[edges[k]];
+			int adj = forward ? edge.to : edge.from;
+			double dis = top.key + edge.weight;
+			if (forward && dis < scratch.getDis(adj))
+			{
+				scratch.setDis(adj, dis, edges[k]);
+				heap.push(dis, adj);
+			}
+			else if (!forward && dis < scratch.getBackDis(adj))
+			{
+				scratch.setBackDis(adj, dis, edges[k]);
+				heap.push(dis, adj);
+			}
+		}
+	}
+	return meet;
+}
+
+/*
+* Chains are walked from skeleton stations. Stations left unvisited are on loops without any skeleton station,
+* then one station of such a loop becomes a skeleton station and the loop is walked from it.
+* Tables between skeleton stations are computed by Dijkstra from every skeleton station in parallel.
+*/
+void Metro::buildSkeleton()
+{
+	METRIC_PHASE(metrics, SKELETON);
+	int n = net->graph.size();
+	// neighbours regardless of the direction of edges
+	vector<vector<int>> adj(n);
+	for (int i = 0; i < n; ++i)
+		for (int e = net->graph.offset[i]; e < net->graph.offset[i + 1]; ++e)
+		{
+			adj[i].push_back(net->graph.target[e]);
+			adj[net->graph.target[e]].push_back(i);
+		}
+	for (int i = 0; i < n; ++i)
+	{
+		sort(adj[i].begin(), adj[i].end());
+		adj[i].erase(unique(adj[i].begin(), adj[i].end()), adj[i].end());
+	}
+
+	const vector<double> &weight = edgeWeight();
+	// a skeleton never changes once it's shared, thus a new one is built
+	shared_ptr<Skeleton> built = make_shared<Skeleton>();
+	Skeleton &sk = *built;
+	sk.num.assign(n, -1);
+	sk.chainOf.assign(n, -1);
+	sk.chainPos.assign(n, -1);
+	sk.chainOff.assign(1, 0);
+	auto isChain = [&](int i) {return adj[i].size() == 2 && !net->stat[i].isTrans && sk.num[i] < 0; };
+	auto addSkeleton = [&](int i) {
+		sk.num[i] = sk.stat.size();
+		sk.stat.push_back(i);
+	};
+	// prefix distances are added for the last station pushed into chainStat
+	auto pushChain = [&](int i) {
+		int pos = sk.chainStat.size();
+		sk.chainStat.push_back(i);
+		if (pos == sk.chainOff.back())
+		{
+			sk.fwd.push_back(0), sk.bwd.push_back(0);
+			sk.fwdBroken.push_back(0), sk.bwdBroken.push_back(0);
+			return;
+		}
+		int last = sk.chainStat[pos - 1], f = net->graph.findEdge(last, i), b = net->graph.findEdge(i, last);
+		// a closed segment can't be passed, just like a one-way section against its direction
+		f = f >= 0 && weight[f] == INF ? -1 : f;
+		b = b >= 0 && weight[b] == INF ? -1 : b;
+		sk.fwd.push_back(sk.fwd.back() + (f < 0 ? 0 : weight[f]));
+		sk.bwd.push_back(sk.bwd.back() + (b < 0 ? 0 : weight[b]));
+		sk.fwdBroken.push_back(sk.fwdBroken.back() + (f < 0));
+		sk.bwdBroken.push_back(sk.bwdBroken.back() + (b < 0));
+	};
+	// walk all chains leaving skeleton station i
+	auto walkChains = [&](int i) {
+		for (vector<int>::const_iterator iter = adj[i].begin(); iter != adj[i].end(); ++iter)
+		{
+			int last = i, cur = *iter;
+			if (!isChain(cur) || sk.chainOf[cur] >= 0)
+				continue;
+			int chain = sk.chainOff.size() - 1;
+			pushChain(i);
+			while (isChain(cur))
+			{
+				sk.chainOf[cur] = chain;
+				sk.chainPos[cur] = sk.chainStat.size();
+				pushChain(cur);
+				int next = adj[cur][0] == last ? adj[cur][1] : adj[cur][0];
+				last = cur;
+				cur = next;
+			}
+			pushChain(cur);
+			sk.chainOff.push_back(sk.chainStat.size());
+		}
+	};
+
+	for (int i = 0; i < n; ++i)
+		if (!isChain(i))
+			addSkeleton(i);
+	for (int k = 0; k < sk.size(); ++k)
+		walkChains(sk.stat[k]);
+	for (int i = 0; i < n; ++i)
+		if (sk.num[i] < 0 && sk.chainOf[i] < 0)
+		{
+			addSkeleton(i);
+			walkChains(i);
+		}
+
+	// edges of the skeleton, an original edge or a chain, only the shortest one is kept between two skeleton stations
+	int k = sk.size();
+	vector<vector<pair<int, pair<double, int>>>> out(k);
+	auto addEdge = [&](int from, int to, double weight, int chain) {
+		for (vector<pair<int, pair<double, int>>>::iterator iter = out[from].begin(); iter != out[from].end(); ++iter)
+			if ((*iter).first == to)
+			{
+				if (weight < (*iter).second.first)
+					(*iter).second = make_pair(weight, chain);
+				return;
+			}
+		out[from].push_back(make_pair(to, make_pair(weight, chain)));
+	};
+	for (int i = 0; i < n; ++i)
+		for (int e = net->graph.offset[i]; e < net->graph.offset[i + 1]; ++e)
+			if (sk.num[i] >= 0 && sk.num[net->graph.target[e]] >= 0)
+				addEdge(sk.num[i], sk.num[net->graph.target[e]], weight[e], -1);
+	for (int c = 0; c + 1 < (int)sk.chainOff.size(); ++c)
+	{
+		int first = sk.chainOff[c], last = sk.chainOff[c + 1] - 1;
+		int a = sk.num[sk.chainStat[first]], b = sk.num[sk.chainStat[last]];
+		if (sk.fwdBroken[last] == 0)
+			addEdge(a, b, sk.fwd[last], 2 * c);
+		if (sk.bwdBroken[last] == 0)
+			addEdge(b, a, sk.bwd[last], 2 * c + 1);
+	}
+	sk.graph.offset.assign(1, 0);
+	for (int a = 0; a < k; ++a)
+	{
+		for (vector<pair<int, pair<double, int>>>::const_iterator iter = out[a].begin(); iter != out[a].end(); ++iter)
+		{
+			sk.graph.target.push_back((*iter).first);
+			sk.graph.weight.push_back((*iter).second.first);
+			sk.edgeChain.push_back((*iter).second.second);
+		}
+		sk.graph.offset.push_back(sk.graph.target.size());
+	}
+
+	sk.dis.assign((size_t)k * k, INF);
+	sk.prev.assign((size_t)k * k, -1);
+	parallelFor(k, [&](int src) {
+		QueryScratch &scratch = threadScratch();
+		scratch.reset(k);
+		scratch.setDis(src, 0, -1);
+		scratch.heap.push(0, src);
+		while (!scratch.heap.empty())
+		{
+			MinHeap::Elem top = scratch.heap.top();
+			scratch.heap.pop();
+			if (top.key > scratch.getDis(top.num))
+				continue;
+			sk.dis[(size_t)src * k + top.num] = top.key;
+			sk.prev[(size_t)src * k + top.num] = scratch.prev[top.num];
+			for (int e = sk.graph.offset[top.num]; e < sk.graph.offset[top.num + 1]; ++e)
+			{
+				double dis = top.key + sk.graph.weight[e];
+				if (dis < scratch.getDis(sk.graph.target[e]))
+				{
+					scratch.setDis(sk.graph.target[e], dis, top.num);
+					scratch.heap.push(dis, sk.graph.target[e]);
+				}
+			}
+		}
+	});
+	skeleton = built;
+}
+
+double Metro::chainDis(int from, int to)const
+{
+	if (from < to)
+		return skeleton->fwdBroken[from] == skeleton->fwdBroken[to] ? skeleton->fwd[to] - skeleton->fwd[from] : INF;
+	return skeleton->bwdBroken[from] == skeleton->bwdBroken[to] ? skeleton->bwd[from] - skeleton->bwd[to] : INF;
+}
+
+int Metro::skeletonEnds(int num, bool leaving, SkeletonEnd *ends)const
+{
+	if (skeleton->num[num] >= 0)
+	{
+		SkeletonEnd self = { -1, -1, skeleton->num[num], 0 };
+		ends[0] = self;
+		return 1;
+	}
+	int c = skeleton->chainOf[num], pos = skeleton->chainPos[num];
+	int boundary[2] = { skeleton->chainOff[c], skeleton->chainOff[c + 1] - 1 };
+	for (int i = 0; i < 2; ++i)
+	{
+		ends[i].pos = pos;
+		ends[i].end = boundary[i];
+		ends[i].num = skeleton->num[skeleton->chainStat[boundary[i]]];
+		ends[i].dis = leaving ? chainDis(pos, boundary[i]) : chainDis(boundary[i], pos);
+	}
+	return 2;
+}
+
+// each combination is a chain offset from the source, a table lookup and a chain offset to the destination
+double Metro::skeletonQuery(int src, int des, SkeletonEnd &leave, SkeletonEnd &enter)const
+{
+	SkeletonEnd srcEnds[2], desEnds[2];
+	int srcCount = skeletonEnds(src, true, srcEnds), desCount = skeletonEnds(des, false, desEnds);
+	int k = skeleton->size();
+	double best = INF;
+	// two stations in the same chain may be connected directly along it
+	if (src == des || (skeleton->chainOf[src] >= 0 && skeleton->chainOf[src] == skeleton->chainOf[des]))
+	{
+		best = src == des ? 0 : chainDis(skeleton->chainPos[src], skeleton->chainPos[des]);
+		leave.end = enter.end = -1;
+		leave.pos = skeleton->chainPos[src];
+		enter.pos = skeleton->chainPos[des];
+	}
+	for (int i = 0; i < srcCount; ++i)
+		for (int j = 0; j < desCount; ++j)
+		{
+			double dis = srcEnds[i].dis + skeleton->dis[(size_t)srcEnds[i].num * k + desEnds[j].num] + desEnds[j].dis;
+			if (dis < best)
+			{
+				best = dis;
+				leave = srcEnds[i];
+				enter = desEnds[j];
+			}
+		}
+	return best;
+}
+
+// a state is made for every line which passes a station, no matter it arrives or leaves
+void Metro::Network::buildStateGraph()
+{
+	int n = graph.size();
+	vector<LineSet> served(n);
+	for (int i = 0; i < n; ++i)
+		for (int e = graph.offset[i]; e < graph.offset[i + 1]; ++e)
+			for (int w = 0; w < MAX_LINE_NUM / 64; ++w)
+			{
+				served[i].word[w] |= graph.lines[e].word[w];
+				served[graph.target[e]].word[w] |= graph.lines[e].word[w];
+			}
+
+	statStateOff.assign(1, 0);
+	stateStat.clear();
+	stateLine.clear();
+	for (int i = 0; i < n; ++i)
+	{
+		for (int line = served[i].next(0); line >= 0; line = served[i].next(line + 1))
+		{
+			stateStat.push_back(i);
+			stateLine.push_back(line);
+		}
+		statStateOff.push_back(stateStat.size());
+	}
+
+	// state (i, line) goes to state (j, line) when the line passes edge i -> j
+	stateGraph.offset.assign(1, 0);
+	stateGraph.target.clear();
+	stateGraph.weight.clear();
+	for (int s = 0; s < (int)stateStat.size(); ++s)
+	{
+		int i = stateStat[s];
+		for (int e = graph.offset[i]; e < graph.offset[i + 1]; ++e)
+		{
+			if (!graph.lines[e].test(stateLine[s]))
+				continue;
+			int t = statStateOff[graph.target[e]];
+			while (stateLine[t] != stateLine[s])
+				++t;
+			stateGraph.target.push_back(t);
+			stateGraph.weight.push_back(graph.weight[e]);
+		}
+		stateGraph.offset.push_back(stateGraph.target.size());
+	}
+}
+
+// all states of source station start from 0, so the first line is free to choose
+int Metro::lineAwareDijkstra(int src, int des, double penalty, QueryScratch &scratch)const
+{
+	const vector<double> &weight = stateWeight();
+	scratch.reset(net->stateStat.size());
+	for (int s = net->statStateOff[src]; s < net->statStateOff[src + 1]; ++s)
+	{
+		scratch.setDis(s, 0, -1);
+		scratch.heap.push(0, s);
+	}
+
+	while (!scratch.heap.empty())
+	{
+		MinHeap::Elem top = scratch.heap.top();
+		scratch.heap.pop();
+		// skip outdated pairs
+		if (top.key > scratch.getDis(top.num))
+			continue;
+		int i = net->stateStat[top.num];
+		if (i == des)
+			return top.num;
+		METRIC_ADD(scratch.settled, 1);
+		METRIC_ADD(scratch.relaxed, net->stateGraph.offset[top.num + 1] - net->stateGraph.offset[top.num] + net->statStateOff[i + 1] - net->statStateOff[i] - 1);
+
+		// ride along the line
+		for (int e = net->stateGraph.offset[top.num]; e < net->stateGraph.offset[top.num + 1]; ++e)
+		{
+			int adj = net->stateGraph.target[e];
+			double dis = top.key + weight[e];
+			if (dis < scratch.getDis(adj))
+			{
+				scratch.setDis(adj, dis, top.num);
+				scratch.heap.push(dis, adj);
+			}
+		}
+		// transfer to another line at the same station
+		for (int adj = net->statStateOff[i]; adj < net->statStateOff[i + 1]; ++adj)
+		{
+			double dis = top.key + penalty;
+			if (adj != top.num && dis < scratch.getDis(adj))
+			{
+				scratch.setDis(adj, dis, top.num);
+				scratch.heap.push(dis, adj);
+			}
+		}
+	}
+	return -1;
+}
+
+void Metro::Network::buildPatterns()
+{
+	patternOff.assign(1, 0);
+	patternLine.clear();
+	patternStat.clear();
+	patternEdge.clear();
+	stopPattern.clear();
+	for (vector<Route>::const_iterator iter = rout.begin(); iter != rout.end(); ++iter)
+	{
+		vector<int> stations = (*iter).myStat;
+		if ((*iter).isLoop && stations.size() > 2 && stations.front() == stations.back())
+			stations.insert(stations.end(), stations.begin() + 1, stations.end() - 1);
+		for (int direc = 0; direc < 2; ++direc)
+		{
+			if (direc == 1)
+				reverse(stations.begin(), stations.end());
+			for (int i = 0; i < (int)stations.size(); ++i)
+			{
+				// a pattern goes on if the line can ride from the last stop to this one
+				int e = i == 0 ? -1 : graph.findEdge(stations[i - 1], stations[i]);
+				bool ride = e >= 0 && graph.lines[e].test((*iter).id);
+				if (!ride && patternStat.size() - patternOff.back() >= 2)
+				{
+					patternOff.push_back(patternStat.size());
+					patternLine.push_back((*iter).id);
+				}
+				else if (!ride)
+				{
+					// a single stop isn't a pattern
+					patternStat.resize(patternOff.back());
+					patternEdge.resize(patternOff.back());
+				}
+				patternEdge.push_back(ride ? e : -1);
+				patternStat.push_back(stations[i]);
+			}
+			if (patternStat.size() - patternOff.back() >= 2)
+			{
+				patternOff.push_back(patternStat.size());
+				patternLine.push_back((*iter).id);
+			}
+			patternStat.resize(patternOff.back());
+			patternEdge.resize(patternOff.back());
+		}
+	}
+
+	int n = graph.size();
+	for (int p = 0; p + 1 < (int)patternOff.size(); ++p)
+		stopPattern.insert(stopPattern.end(), patternOff[p + 1] - patternOff[p], p);
+
+	// branches of a line (routes with the same name) meet at a station, and going on from one to another isn't a transfer,
+	// thus a pattern up to such a station followed by another one after it is a pattern too, unless it turns back
+	// or the two still go on together, then they're joined where they part
+	int patterns = patternLine.size();
+	vector<vector<int>> stops(n);
+	for (int s = 0; s < patternOff[patterns]; ++s)
+		stops[patternStat[s]].push_back(s);
+	for (int p = 0; p < patterns; ++p)
+		for (int a = patternOff[p] + 1; a < patternOff[p + 1]; ++a)
+			for (vector<int>::iterator b = stops[patternStat[a]].begin(); b != stops[patternStat[a]].end(); ++b)
+			{
+				int q = stopPattern[*b];
+				if (q == p || patternLine[q] != patternLine[p] || *b + 1 == patternOff[q + 1]
+					|| patternStat[*b + 1] == patternStat[a - 1]
+					|| (a + 1 < patternOff[p + 1] && patternStat[*b + 1] == patternStat[a + 1]))
+					continue;
+				for (int stop = patternOff[p]; stop <= a; ++stop)
+				{
+					patternStat.push_back(patternStat[stop]);
+					patternEdge.push_back(patternEdge[stop]);
+				}
+				// the edge entering the stop after b leaves the station of b, which is the station of a
+				for (int stop = *b + 1; stop < patternOff[q + 1]; ++stop)
+				{
+					patternStat.push_back(patternStat[stop]);
+					patternEdge.push_back(patternEdge[stop]);
+				}
+				patternOff.push_back(patternStat.size());
+				patternLine.push_back(patternLine[p]);
+				stopPattern.resize(patternStat.size(), patternLine.size() - 1);
+			}
+	statStopOff.assign(n + 1, 0);
+	for (int s = 0; s < (int)patternStat.size(); ++s)
+		++statStopOff[patternStat[s] + 1];
+	for (int i = 0; i < n; ++i)
+		statStopOff[i + 1] += statStopOff[i];
+	statStop.resize(patternStat.size());
+	vector<int> pos(statStopOff.begin(), statStopOff.end() - 1);
+	for (int s = 0; s < (int)patternStat.size(); ++s)
+		statStop[pos[patternStat[s]]++] = s;
+
+	int m = graph.target.size();
+	edgeStopOff.assign(m + 1, 0);
+	for (int s = 0; s < (int)patternEdge.size(); ++s)
+		if (patternEdge[s] >= 0)
+			++edgeStopOff[patternEdge[s] + 1];
+	for (int e = 0; e < m; ++e)
+		edgeStopOff[e + 1] += edgeStopOff[e];
+	edgeStop.resize(edgeStopOff[m]);
+	pos.assign(edgeStopOff.begin(), edgeStopOff.end() - 1);
+	for (int s = 0; s < (int)patternEdge.size(); ++s)
+		if (patternEdge[s] >= 0)
+			edgeStop[pos[patternEdge[s]]++] = s;
+
+	patternDis.resize(patternStat.size());
+	patternCut.resize(patternStat.size());
+	for (int p = 0; p < (int)patternLine.size(); ++p)
+		patternWeights(p, graph.weight, patternDis, patternCut);
+}
+
+void Metro::Network::patternWeights(int p, const vector<double> &weight, vector<double> &dis, vector<int> &cut)const
+{
+	dis[patternOff[p]] = 0;
+	cut[patternOff[p]] = 0;
+	for (int stop = patternOff[p] + 1; stop < patternOff[p + 1]; ++stop)
+	{
+		double w = weight[patternEdge[stop]];
+		dis[stop] = dis[stop - 1] + (w == INF ? 0 : w);
+		cut[stop] = cut[stop - 1] + (w == INF ? 1 : 0);
+	}
+}
+
+/*
+* Round k scans every pattern serving a station improved in round k - 1, from the first such stop to the end.
+* While riding, the best stop to board so far is kept, as the label of round k - 1 minus the distance of the stop in the pattern,
+* thus every stop costs O(1) and a pattern costs O(its length). A label is improved only if it's shorter than the best one
+* of the station in all rounds and the best one of destination, so only routes with fewer rides or shorter distance survive.
+* It stops when no station is improved, and labels of all rounds are kept to walk routes back.
+*/
+int Metro::raptor(int src, int des, QueryScratch &scratch)const
+{
+	const vector<double> &dis = stopDis();
+	const vector<int> &cut = stopCut();
+	int n = net->graph.size();
+	// dis of the scratch is the best label of each station in all rounds
+	scratch.reset(n);
+	scratch.setDis(src, 0, -1);
+	scratch.roundDis.assign(n, INF);
+	scratch.roundBoard.assign(n, -1);
+	scratch.roundAlight.assign(n, -1);
+	scratch.roundDis[src] = 0;
+	if ((int)scratch.isMarked.size() != n)
+		scratch.isMarked.assign(n, false);
+	if (scratch.patternFrom.size() != net->patternLine.size())
+		scratch.patternFrom.assign(net->patternLine.size(), -1);
+	scratch.marked.assign(1, src);
+	scratch.isMarked[src] = true;
+
+	int round = 0;
+	while (!scratch.marked.empty())
+	{
+		++round;
+		// queue patterns by their first marked stops
+		scratch.queued.clear();
+		for (vector<int>::iterator iter = scratch.marked.begin(); iter != scratch.marked.end(); ++iter)
+		{
+			scratch.isMarked[*iter] = false;
+			for (int k = net->statStopOff[*iter]; k < net->statStopOff[*iter + 1]; ++k)
+			{
+				int stop = net->statStop[k], p = net->stopPattern[stop];
+				if (scratch.patternFrom[p] < 0)
+					scratch.queued.push_back(p);
+				if (scratch.patternFrom[p] < 0 || stop < scratch.patternFrom[p])
+					scratch.patternFrom[p] = stop;
+			}
+		}
+		METRIC_ADD(scratch.settled, scratch.marked.size());
+		scratch.marked.clear();
+
+		// labels of this round begin as those of the last round
+		size_t last = (size_t)(round - 1) * n, cur = last + n;
+		scratch.roundDis.resize(cur + n);
+		copy(scratch.roundDis.begin() + last, scratch.roundDis.begin() + cur, scratch.roundDis.begin() + cur);
+		scratch.roundBoard.resize(cur + n, -1);
+		scratch.roundAlight.resize(cur + n, -1);
+		for (vector<int>::iterator iter = scratch.queued.begin(); iter != scratch.queued.end(); ++iter)
+		{
+			int p = *iter, board = -1, boardCut = 0;
+			double boardDis = INF;
+			METRIC_ADD(scratch.relaxed, net->patternOff[p + 1] - scratch.patternFrom[p]);
+			for (int stop = scratch.patternFrom[p]; stop < net->patternOff[p + 1]; ++stop)
+			{
+				int i = net->patternStat[stop];
+				// the ride can't pass a closed segment, thus it has to board again after it
+				if (board >= 0 && cut[stop] != boardCut)
+				{
+					board = -1;
+					boardDis = INF;
+				}
+				double arrive = boardDis + dis[stop];
+				if (board >= 0 && arrive < scratch.getDis(i) && arrive < scratch.getDis(des))
+				{
+					scratch.setDis(i, arrive, -1);
+					scratch.roundDis[cur + i] = arrive;
+					scratch.roundBoard[cur + i] = board;
+					scratch.roundAlight[cur + i] = stop;
+					if (!scratch.isMarked[i])
+					{
+						scratch.isMarked[i] = true;
+						scratch.marked.push_back(i);
+					}
+				}
+				// board here if it's better than boarding where we have boarded
+				double lastDis = scratch.roundDis[last + i];
+				if (lastDis != INF && lastDis - dis[stop] < boardDis)
+				{
+					boardDis = lastDis - dis[stop];
+					board = stop;
+					boardCut = cut[stop];
+				}
+			}
+			scratch.patternFrom[p] = -1;
+		}
+	}
+	return round;
+}
+
+void Metro::paretoRounds(int des, int rounds, const QueryScratch &scratch, vector<int> &result)const
+{
+	result.clear();
+	int n = net->graph.size();
+	double best = INF;
+	for (int k = 1; k <= rounds; ++k)
+		if (scratch.roundDis[(size_t)k * n + des] < best)
+		{
+			best = scratch.roundDis[(size_t)k * n + des];
+			result.push_back(k);
+		}
+}
+
+// get the complete route (all the passed stations) along the shortest path
+// previous stations are walked from destination back to source in the row of source, thus it costs linear time in the length of path
+bool Metro::searchRoute(const string &src, const string &des, vector<int> &route, QueryScratch &scratch)const throw(valueException)
+{
+	int srcNum, desNum; // sequence number of the source station and destination station
+	try
+	{
+		// get number by station's name
+		srcNum = searchStatNum(src);
+		desNum = searchStatNum(des);
+
+		// exception processing
+		if (srcNum < 0)
+			throw valueException(srcNum);
+		else if (desNum < 0)
+			throw valueException(desNum);
+		else if (tableDis(srcNum, desNum) == INF)
+		{
+			if (!scratch.quiet)
+				cout << "Can't arrive!" << endl;
+			throw valueException(INF);
+		}
+
+		// when source station is destination station, the route has only one station
+		METRIC_PHASE(metrics, RECONSTRUCT);
+		route.clear();
+		for (int num = desNum; num != srcNum; num = tablePrev(srcNum, num))
+			route.push_back(num);
+		route.push_back(srcNum);
+		reverse(route.begin(), route.end());
+		return true;
+	}
+	catch (valueException &ex) { if (!scratch.quiet) { cout << ex.what(); ex.printValue(); cout << endl; } }
+	return false;
+}
+
+shared_ptr<const Metro::PathTree> Metro::TreeCache::find(int src)
+{
+	lock_guard<mutex> guard(lock);
+	unordered_map<int, pair<shared_ptr<const PathTree>, list<int>::iterator>>::iterator iter = trees.find(src);
+	if (iter == trees.end())
+	{
+		++misses;
+		return nullptr;
+	}
+	++hits;
+	order.splice(order.begin(), order, iter->second.second);
+	return iter->second.first;
+}
+
+void Metro::TreeCache::insert(int src, shared_ptr<const PathTree> tree)
+{
+	lock_guard<mutex> guard(lock);
+	// another thread may have inserted the same tree
+	if (trees.count(src) > 0)
+		return;
+	if (trees.size() >= TREE_CACHE_SIZE)
+	{
+		trees.erase(order.back());
+		order.pop_back();
+	}
+	order.push_front(src);
+	trees[src] = make_pair(tree, order.begin());
+}
+
+void Metro::TreeCache::clear()
+{
+	lock_guard<mutex> guard(lock);
+	trees.clear();
+	order.clear();
+}
+
+shared_ptr<const Metro::PathTree> Metro::sourceTree(int src, QueryScratch &scratch)const
+{
+	shared_ptr<const PathTree> tree = treeCache.find(src);
+	if (tree)
+		return tree;
+
+	METRIC_ADD(scratch.allocations, 3);
+	heapDijkstra(src, -1, scratch);
+	int n = net->graph.size();
+	shared_ptr<PathTree> newTree(new PathTree);
+	newTree->dis.resize(n);
+	newTree->prev.resize(n);
+	for (int i = 0; i < n; ++i)
+	{
+		newTree->dis[i] = scratch.getDis(i);
+		newTree->prev[i] = newTree->dis[i] == INF ? -1 : scratch.prev[i];
+	}
+	treeCache.insert(src, newTree);
+	return newTree;
+}
+
+shared_ptr<const Metro::PathTree> Metro::targetTree(int des, QueryScratch &scratch)const
+{
+	shared_ptr<const PathTree> tree = targetCache.find(des);
+	if (tree)
+		return tree;
+
+	METRIC_ADD(scratch.allocations, 3);
+	heapDijkstra(net->reverseGraph, reverseWeight(), des, -1, scratch);
+	int n = net->graph.size();
+	shared_ptr<PathTree> newTree(new PathTree);
+	newTree->dis.resize(n);
+	newTree->prev.resize(n);
+	for (int i = 0; i < n; ++i)
+	{
+		newTree->dis[i] = scratch.getDis(i);
+		newTree->prev[i] = newTree->dis[i] == INF ? -1 : scratch.prev[i];
+	}
+	targetCache.insert(des, newTree);
+	return newTree;
+}
+
+/*
+* Yen's algorithm: the k-th route deviates from one of the routes found before at a spur station,
+* it keeps the root (stations before the spur station) and then takes the shortest spur route to destination,
+* which mustn't pass the root again, nor leave the spur station by the step a route with the same root has taken.
+* Searches are saved in three ways:
+* 1. The tree to destination is computed once (and cached), and the spur route is taken from it directly
+*    when its tree path doesn't meet any blocked station or step, which is the common case.
+* 2. Otherwise A* is guided by the distances in the tree, which are exact lower bounds since blocking only makes routes longer,
+*    thus it settles few stations besides the spur route.
+* 3. A route derived at position d shares its first d + 1 stations with its parent, and every spur station before d
+*    has been tried on the parent already (Lawler's improvement), thus only positions from d on are tried again.
+*/
+void Metro::kShortestRoutes(int src, int des, int k, vector<Candidate> &routes, QueryScratch &scratch)const
+{
+	routes.clear();
+	shared_ptr<const PathTree> tree = targetTree(des, scratch);
+	if (k <= 0 || tree->dis[src] == INF)
+		return;
+
+	Candidate first;
+	first.distance = tree->dis[src];
+	first.deviation = 0;
+	for (int num = src; num >= 0; num = tree->prev[num])
+		first.route.push_back(num);
+	routes.push_back(first);
+
+	// candidates ordered by distance, and routes seen so that a candidate is never added twice
+	multimap<double, Candidate> candidates;
+	set<vector<int>> seen;
+	seen.insert(first.route);
+	// blockedAt[i] is the spur search blocking station i, thus blocked stations are never cleared
+	vector<int> blockedAt(net->graph.size(), -1), blockedNext, spurRoute;
+	int mark = 0;
+	while ((int)routes.size() < k)
+	{
+		const Candidate &last = routes.back();
+		double rootDis = 0;
+		for (int i = 0; i < last.deviation; ++i)
+			rootDis += edgeWeight()[net->graph.findEdge(last.route[i], last.route[i + 1])];
+
+		for (int i = last.deviation; i + 1 < (int)last.route.size(); ++i)
+		{
+			int spur = last.route[i];
+			++mark;
+			for (int j = 0; j < i; ++j)
+				blockedAt[last.route[j]] = mark;
+			// steps from the spur station taken by routes with the same root
+			blockedNext.clear();
+			for (vector<Candidate>::const_iterator iter = routes.begin(); iter != routes.end(); ++iter)
+				if ((int)iter->route.size() > i + 1 && equal(last.route.begin(), last.route.begin() + i + 1, iter->route.begin()))
+					blockedNext.push_back(iter->route[i + 1]);
+
+			double spurDis = spurSearch(spur, des, *tree, blockedAt, mark, blockedNext, spurRoute, scratch);
+			if (spurDis != INF)
+			{
+				Candidate next;
+				next.distance = rootDis + spurDis;
+				next.deviation = i;
+				next.route.assign(last.route.begin(), last.route.begin() + i);
+				next.route.insert(next.route.end(), spurRoute.begin(), spurRoute.end());
+				if (seen.insert(next.route).second)
+					candidates.insert(make_pair(next.distance, next));
+			}
+			rootDis += edgeWeight()[net->graph.findEdge(spur, last.route[i + 1])];
+		}
+
+		if (candidates.empty())
+			break;
+		routes.push_back(candidates.begin()->second);
+		candidates.erase(candidates.begin());
+	}
+}
+
+double Metro::spurSearch(int spur, int des, const PathTree &tree, const vector<int> &blockedAt, int mark,
+	const vector<int> &blockedNext, vector<int> &spurRoute, QueryScratch &scratch)const
+{
+	const vector<double> &weight = edgeWeight();
+	spurRoute.clear();
+	const vector<double> &toDes = tree.dis;
+
+	// the tree path, if nothing on it is blocked
+	bool free = toDes[spur] != INF && find(blockedNext.begin(), blockedNext.end(), tree.prev[spur]) == blockedNext.end();
+	for (int num = spur; free && num >= 0; num = tree.prev[num])
+		free = blockedAt[num] != mark;
+	if (free)
+	{
+		for (int num = spur; num >= 0; num = tree.prev[num])
+			spurRoute.push_back(num);
+		return toDes[spur];
+	}
+
+	// keys in the heap are distance from the spur station plus distance to destination
+	scratch.reset(net->graph.size());
+	scratch.setDis(spur, 0, -1);
+	scratch.heap.push(toDes[spur], spur);
+	while (!scratch.heap.empty())
+	{
+		MinHeap::Elem top = scratch.heap.top();
+		scratch.heap.pop();
+		double dis = scratch.getDis(top.num);
+		// skip outdated pairs
+		if (top.key > dis + toDes[top.num])
+			continue;
+		if (top.num == des)
+			break;
+		METRIC_ADD(scratch.settled, 1);
+		METRIC_ADD(scratch.relaxed, net->graph.offset[top.num + 1] - net->graph.offset[top.num]);
+
+		for (int e = net->graph.offset[top.num]; e < net->graph.offset[top.num + 1]; ++e)
+		{
+			int adj = net->graph.target[e];
+			if (blockedAt[adj] == mark || toDes[adj] == INF
+				|| (top.num == spur && find(blockedNext.begin(), blockedNext.end(), adj) != blockedNext.end()))
+				continue;
+			double adjDis = dis + weight[e];
+			if (adjDis < scratch.getDis(adj))
+			{
+				scratch.setDis(adj, adjDis, top.num);
+				scratch.heap.push(adjDis + toDes[adj], adj);
+			}
+		}
+	}
+	if (scratch.getDis(des) == INF)
+		return INF;
+	for (int num = des; num >= 0; num = scratch.prev[num])
+		spurRoute.push_back(num);
+	reverse(spurRoute.begin(), spurRoute.end());
+	return scratch.getDis(des);
+}
+
+// a transfer happens wherever the best lines change, the same as printRoute
+int Metro::transferCount(const vector<LineSet> &best)
+{
+	int transfers = 0;
+	for (int i = 1; i < (int)best.size(); ++i)
+		transfers += best[i] != best[i - 1];
+	return transfers;
+}
+
+vector<Metro::Itinerary> Metro::alternatives(const string &src, const string &des, int k)const
+{
+	vector<Itinerary> result;
+	int srcNum = searchStatNum(src), desNum = searchStatNum(des);
+	if (srcNum < 0 || desNum < 0)
+		return result;
+
+	QueryScratch &scratch = threadScratch();
+	vector<Candidate> routes;
+#if METRICS
+	chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+	scratch.settled = scratch.relaxed = scratch.allocations = 0;
+#endif
+	{
+		METRIC_PHASE(metrics, SEARCH);
+		kShortestRoutes(srcNum, desNum, k, routes, scratch);
+	}
+	METRIC_PHASE(metrics, LINES);
+	for (vector<Candidate>::iterator iter = routes.begin(); iter != routes.end(); ++iter)
+	{
+		availableRoute(iter->route.data(), iter->route.size(), scratch.lines);
+		bestRoutSelect(scratch.lines);
+		result.push_back(makeItinerary(iter->distance, iter->route, scratch.lines));
+	}
+#if METRICS
+	countQuery(scratch, routes.empty() ? 0 : routes[0].route.size(), chrono::steady_clock::now() - begin);
+#endif
+	return result;
+}
+
+Metro::Itinerary Metro::makeItinerary(double distance, const vector<int> &route, const vector<LineSet> &lines)const
+{
+	Itinerary itinerary;
+	itinerary.distance = distance;
+	itinerary.transfers = transferCount(lines);
+	for (vector<int>::const_iterator num = route.begin(); num != route.end(); ++num)
+		itinerary.stations.push_back(getStatName(*num));
+	for (int i = 0; i < (int)lines.size(); ++i)
+	{
+		itinerary.lines.push_back(vector<string>());
+		for (int line = lines[i].next(0); line >= 0; line = lines[i].next(line + 1))
+			itinerary.lines.back().push_back(net->lineNames.name(line));
+	}
+	return itinerary;
+}
+
+vector<Metro::Itinerary> Metro::paretoRoutes(const string &src, const string &des)const
+{
+	vector<Itinerary> result;
+	int srcNum = searchStatNum(src), desNum = searchStatNum(des);
+	if (srcNum < 0 || desNum < 0)
+		return result;
+
+	QueryScratch &scratch = threadScratch();
+	vector<int> pareto;
+#if METRICS
+	chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+	scratch.settled = scratch.relaxed = scratch.allocations = 0;
+#endif
+	{
+		METRIC_PHASE(metrics, SEARCH);
+		paretoRounds(desNum, raptor(srcNum, desNum, scratch), scratch, pareto);
+	}
+	if (srcNum == desNum)
+		pareto.assign(1, 0);
+	for (vector<int>::iterator round = pareto.begin(); round != pareto.end(); ++round)
+	{
+		raptorRoute(srcNum, desNum, *round, scratch, scratch.route, scratch.lines);
+		result.push_back(makeItinerary(scratch.roundDis[(size_t)*round * net->graph.size() + desNum], scratch.route, scratch.lines));
+	}
+#if METRICS
+	countQuery(scratch, result.empty() ? 0 : result.back().stations.size(), chrono::steady_clock::now() - begin);
+#endif
+	return result;
+}
+
+/*
+* Connections are scanned from the first one leaving at the departure time, a connection can be taken if its train leaves
+* the station after we arrive there, and it improves the arrival at the next station. Since all later connections leave later,
+* the scan stops when a connection leaves after the arrival at destination. Closed segments and stations are skipped.
+*/
+bool Metro::connectionScan(int src, int des, int departure, QueryScratch &scratch)const
+{
+	scratch.reset(net->graph.size());
+	scratch.setDis(src, departure, -1);
+	vector<Connection>::const_iterator conn = lower_bound(net->connections.begin(), net->connections.end(), departure,
+		[](const Connection &c, int time) { return c.departure < time; });
+	for (; conn != net->connections.end() && conn->departure < scratch.getDis(des); ++conn)
+	{
+		METRIC_ADD(scratch.relaxed, 1);
+		if (scratch.getDis(conn->from) <= conn->departure && conn->arrival < scratch.getDis(conn->to) && edgeWeight()[conn->edge] != INF)
+		{
+			scratch.setDis(conn->to, conn->arrival, conn - net->connections.begin());
+			METRIC_ADD(scratch.settled, 1);
+		}
+	}
+	return scratch.getDis(des) != INF;
+}
+
+void Metro::connectionRoute(int des, const QueryScratch &scratch, vector<int> &route)const
+{
+	METRIC_PHASE(metrics, RECONSTRUCT);
+	route.clear();
+	for (int conn = scratch.prev[des]; conn >= 0; conn = scratch.prev[net->connections[conn].from])
+		route.push_back(conn);
+	reverse(route.begin(), route.end());
+}
+
+bool Metro::earliestArrival(const string &src, const string &des, int departure, Journey &journey)const
+{
+	int srcNum = searchStatNum(src), desNum = searchStatNum(des);
+	if (srcNum < 0 || desNum < 0)
+		return false;
+
+	QueryScratch &scratch = threadScratch();
+	bool found;
+#if METRICS
+	chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+	scratch.settled = scratch.relaxed = scratch.allocations = 0;
+#endif
+	{
+		METRIC_PHASE(metrics, SEARCH);
+		found = connectionScan(srcNum, desNum, departure, scratch);
+	}
+	vector<int> &route = scratch.route;  // connections taken instead of stations
+	route.clear();
+	if (found)
+		connectionRoute(desNum, scratch, route);
+#if METRICS
+	countQuery(scratch, found ? route.size() + 1 : 0, chrono::steady_clock::now() - begin);
+#endif
+	if (!found)
+		return false;
+
+	journey.departure = route.empty() ? departure : net->connections[route.front()].departure;
+	journey.arrival = route.empty() ? departure : net->connections[route.back()].arrival;
+	journey.transfers = 0;
+	journey.stations.assign(1, src);
+	journey.times.assign(1, journey.departure);
+	journey.lines.clear();
+	for (int i = 0; i < (int)route.size(); ++i)
+	{
+		const Connection &conn = net->connections[route[i]];
+		if (i > 0 && conn.line != net->connections[route[i - 1]].line)
+			++journey.transfers;
+		journey.stations.push_back(getStatName(conn.to));
+		journey.times.push_back(conn.arrival);
+		journey.lines.push_back(vector<string>(1, net->lineNames.name(conn.line)));
+	}
+	return true;
+}
+
+// targets are unmarked when they're settled, and the rest when it stops, thus isMarked is clear again afterwards
+void Metro::boundedDijkstra(int src, double radius, int targets, QueryScratch &scratch)const
+{
+	const vector<double> &weight = edgeWeight();
+	scratch.reset(net->graph.size());
+	scratch.route.clear();
+	scratch.setDis(src, 0, -1);
+	scratch.heap.push(0, src);
+
+	while (!scratch.heap.empty())
+	{
+		MinHeap::Elem top = scratch.heap.top();
+		scratch.heap.pop();
+		if (top.key > scratch.getDis(top.num))
+			continue;
+		// all the rest are farther
+		if (top.key > radius)
+			break;
+		scratch.route.push_back(top.num);
+		if (scratch.isMarked[top.num])
+		{
+			scratch.isMarked[top.num] = false;
+			if (--targets == 0)
+				break;
+		}
+		METRIC_ADD(scratch.settled, 1);
+		METRIC_ADD(scratch.relaxed, net->graph.offset[top.num + 1] - net->graph.offset[top.num]);
+
+		for (int e = net->graph.offset[top.num]; e < net->graph.offset[top.num + 1]; ++e)
+		{
+			int adj = net->graph.target[e];
+			double dis = top.key + weight[e];
+			if (dis < scratch.getDis(adj) && dis <= radius)
+			{
+				scratch.setDis(adj, dis, top.num);
+				scratch.heap.push(dis, adj);
+			}
+		}
+	}
+}
+
+void Metro::oneToMany(int src, const vector<int> &targets, double *out, QueryScratch &scratch)const
+{
+	if (src < 0)
+	{
+		fill(out, out + targets.size(), INF);
+		return;
+	}
+	// a row of the tables has them all
+	if (hasTables())
+	{
+		for (int t = 0; t < (int)targets.size(); ++t)
+			out[t] = targets[t] < 0 ? INF : tableDis(src, targets[t]);
+		return;
+	}
+
+	if ((int)scratch.isMarked.size() != net->graph.size())
+		scratch.isMarked.assign(net->graph.size(), false);
+	int count = 0;
+	for (vector<int>::const_iterator t = targets.begin(); t != targets.end(); ++t)
+		if (*t >= 0 && !scratch.isMarked[*t])
+		{
+			scratch.isMarked[*t] = true;
+			++count;
+		}
+	if (count > 0)
+	{
+		METRIC_PHASE(metrics, SEARCH);
+		boundedDijkstra(src, INF, count, scratch);
+	}
+	for (int t = 0; t < (int)targets.size(); ++t)
+	{
+		out[t] = targets[t] < 0 ? INF : scratch.getDis(targets[t]);
+		// targets which can't be reached are still marked
+		if (targets[t] >= 0)
+			scratch.isMarked[targets[t]] = false;
+	}
+}
+
+vector<double> Metro::distances(const string &src, const vector<string> &targets)const
+{
+	return distanceTable(vector<string>(1, src), targets);
+}
+
+vector<double> Metro::distanceTable(const vector<string> &sources, const vector<string> &targets)const
+{
+	vector<int> srcNum(sources.size()), desNum(targets.size());
+	for (int i = 0; i < (int)sources.size(); ++i)
+		srcNum[i] = searchStatNum(sources[i]);
+	for (int i = 0; i < (int)targets.size(); ++i)
+		desNum[i] = searchStatNum(targets[i]);
+
+	vector<double> table(sources.size() * targets.size());
+	auto row = [&](int s) {
+		QueryScratch &scratch = threadScratch();
+#if METRICS
+		scratch.settled = scratch.relaxed = scratch.allocations = 0;
+#endif
+		double *out = table.data() + (size_t)s * targets.size();
+		oneToMany(srcNum[s], desNum, out, scratch);
+		// a search is shared by the row, thus counted once, and latency isn't recorded, the same as batch mode
+		METRIC_COUNT(metrics, QUERIES, targets.size());
+		METRIC_COUNT(metrics, FAILED, count(out, out + targets.size(), INF));
+		METRIC_COUNT(metrics, SETTLED, scratch.settled);
+		METRIC_COUNT(metrics, RELAXED, scratch.relaxed);
+		METRIC_COUNT(metrics, ALLOCATIONS, scratch.allocations);
+	};
+	if (sources.size() == 1)
+		row(0);
+	else
+		parallelFor(sources.size(), row);
+	return table;
+}
+
+void Metro::isochrone(const string &src, double radius, vector<string> &stations, vector<double> &dis)const
+{
+	stations.clear();
+	dis.clear();
+	int srcNum = searchStatNum(src);
+	if (srcNum < 0)
+		return;
+
+	QueryScratch &scratch = threadScratch();
+#if METRICS
+	chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+	scratch.settled = scratch.relaxed = scratch.allocations = 0;
+#endif
+	if ((int)scratch.isMarked.size() != net->graph.size())
+		scratch.isMarked.assign(net->graph.size(), false);
+	{
+		METRIC_PHASE(metrics, SEARCH);
+		boundedDijkstra(srcNum, radius, 0, scratch);
+	}
+	for (vector<int>::iterator num = scratch.route.begin(); num != scratch.route.end(); ++num)
+	{
+		stations.push_back(getStatName(*num));
+		dis.push_back(scratch.getDis(*num));
+	}
+#if METRICS
+	countQuery(scratch, scratch.route.size(), chrono::steady_clock::now() - begin);
+#endif
+}
+
+// get the complete route (all the passed stations) by the heap-based Dijkstra engine
+bool Metro::heapSearchRoute(const string &src, const string &des, vector<int> &route, QueryScratch &scratch)const throw(valueException)
+{
+	try
+	{
+		// get number by station's name
+		int srcNum = searchStatNum(src), desNum = searchStatNum(des);
+
+		// exception processing
+		if (srcNum < 0)
+			throw valueException(srcNum);
+		else if (desNum < 0)
+			throw valueException(desNum);
+
+		shared_ptr<const PathTree> tree = sourceTree(srcNum, scratch);
+		if (tree->dis[desNum] == INF)
+		{
+			if (!scratch.quiet)
+				cout << "Can't arrive!" << endl;
+			throw valueException(INF);
+		}
+
+		METRIC_PHASE(metrics, RECONSTRUCT);
+		treeRoute(tree->prev.data(), desNum, route);
+		return true;
+	}
+	catch (valueException &ex) { if (!scratch.quiet) { cout << ex.what(); ex.printValue(); cout << endl; } }
+	return false;
+}
+
+// get the complete route (all the passed stations) by the skeleton
+bool Metro::skeletonSearchRoute(const string &src, const string &des, vector<int> &route, QueryScratch &scratch)const throw(valueException)
+{
+	try
+	{
+		// get number by station's name
+		int srcNum = searchStatNum(src), desNum = searchStatNum(des);
+
+		// exception processing
+		if (srcNum < 0)
+			throw valueException(srcNum);
+		else if (desNum < 0)
+			throw valueException(desNum);
+
+		SkeletonEnd leave, enter;
+		if (skeletonQuery(srcNum, desNum, leave, enter) == INF)
+		{
+			if (!scratch.quiet)
+				cout << "Can't arrive!" << endl;
+			throw valueException(INF);
+		}
+
+		METRIC_PHASE(metrics, RECONSTRUCT);
+		route.assign(1, srcNum);
+		if (srcNum == desNum)
+			return true;
+		// along the same chain
+		if (leave.end < 0 && enter.end < 0 && leave.pos >= 0)
+		{
+			chainRoute(leave.pos, enter.pos, route);
+			return true;
+		}
+
+		// from source to the skeleton, then skeleton stations one by one, and from the skeleton to destination at last
+		if (leave.pos >= 0)
+			chainRoute(leave.pos, leave.end, route);
+		int k = skeleton->size();
+		vector<int> relay;
+		for (int num = enter.num; num != leave.num; num = skeleton->prev[(size_t)leave.num * k + num])
+			relay.push_back(num);
+		for (int from = leave.num; !relay.empty(); relay.pop_back())
+		{
+			int to = relay.back(), e = skeleton->graph.findEdge(from, to), chain = skeleton->edgeChain[e];
+			if (chain < 0)
+				route.push_back(skeleton->stat[to]);
+			else if (chain % 2 == 0)
+				chainRoute(skeleton->chainOff[chain / 2], skeleton->chainOff[chain / 2 + 1] - 1, route);
+			else
+				chainRoute(skeleton->chainOff[chain / 2 + 1] - 1, skeleton->chainOff[chain / 2], route);
+			from = to;
+		}
+		if (enter.pos >= 0)
+			chainRoute(enter.end, enter.pos, route);
+		return true;
+	}
+	catch (valueException &ex) { if (!scratch.quiet) { cout << ex.what(); ex.printValue(); cout << endl; } }
+	return false;
+}
+
+void Metro::chainRoute(int from, int to, vector<int> &route)const
+{
+	for (int step = from < to ? 1 : -1; from != to;)
+	{
+		from += step;
+		route.push_back(skeleton->chainStat[from]);
+	}
+}
+
+// get the complete route (all the passed stations) by contraction hierarchies
+bool Metro::hierarchySearchRoute(const string &src, const string &des, vector<int> &route, QueryScratch &scratch)const throw(valueException)
+{
+	try
+	{
+		// get number by station's name
+		int srcNum = searchStatNum(src), desNum = searchStatNum(des);
+
+		// exception processing
+		if (srcNum < 0)
+			throw valueException(srcNum);
+		else if (desNum < 0)
+			throw valueException(desNum);
+
+		int meet = hierarchyDijkstra(srcNum, desNum, scratch);
+		if (meet < 0)
+		{
+			if (!scratch.quiet)
+				cout << "Can't arrive!" << endl;
+			throw valueException(INF);
+		}
+
+		// edges from source up to the meeting station are found backwards, thus they're collected before unpacking
+		METRIC_PHASE(metrics, RECONSTRUCT);
+		vector<int> upward;
+		for (int num = meet; num != srcNum; num = hierarchy->edges[scratch.prev[num]].from)
+			upward.push_back(scratch.prev[num]);
+		route.assign(1, srcNum);
+		for (vector<int>::reverse_iterator iter = upward.rbegin(); iter != upward.rend(); ++iter)
+			unpackEdge(*iter, route);
+		for (int num = meet; num != desNum; num = hierarchy->edges[scratch.next[num]].to)
+			unpackEdge(scratch.next[num], route);
+		return true;
+	}
+	catch (valueException &ex) { if (!scratch.quiet) { cout << ex.what(); ex.printValue(); cout << endl; } }
+	return false;
+}
+
+void Metro::unpackEdge(int e, vector<int> &route)const
+{
+	const HierarchyEdge &edge = hierarchy->edges[e];
+	if (edge.first < 0)
+	{
+		route.push_back(edge.to);
+		return;
+	}
+	unpackEdge(edge.first, route);
+	unpackEdge(edge.second, route);
+}
+
+// get the complete route (all the passed stations) by bidirectional Dijkstra
+bool Metro::bidirectionalSearchRoute(const string &src, const string &des, vector<int> &route, QueryScratch &scratch)const throw(valueException)
+{
+	try
+	{
+		// get number by station's name
+		int srcNum = searchStatNum(src), desNum = searchStatNum(des);
+
+		// exception processing
+		if (srcNum < 0)
+			throw valueException(srcNum);
+		else if (desNum < 0)
+			throw valueException(desNum);
+
+		int meet = bidirectionalDijkstra(srcNum, desNum, scratch);
+		if (meet < 0)
+		{
+			if (!scratch.quiet)
+				cout << "Can't arrive!" << endl;
+			throw valueException(INF);
+		}
+
+		// from source to the meeting station by previous stations, then on to destination by next stations
+		METRIC_PHASE(metrics, RECONSTRUCT);
+		treeRoute(scratch.prev.data(), meet, route);
+		for (int num = scratch.next[meet]; num >= 0; num = scratch.next[num])
+			route.push_back(num);
+		return true;
+	}
+	catch (valueException &ex) { if (!scratch.quiet) { cout << ex.what(); ex.printValue(); cout << endl; } }
+	return false;
+}
+
+// previous stations are walked from destination back to source, then the order is reversed
+void Metro::treeRoute(const int *prev, int des, vector<int> &route)const
+{
+	route.clear();
+	for (int num = des; num >= 0; num = prev[num])
+		route.push_back(num);
+	reverse(route.begin(), route.end());
+}
+
+// get the best route (all the passed stations and lines) by line-aware Dijkstra
+bool Metro::lineAwareSearchRoute(const string &src, const string &des, double penalty, QueryScratch &scratch)const throw(valueException)
+{
+	try
+	{
+		// get number by station's name
+		int srcNum = searchStatNum(src), desNum = searchStatNum(des);
+
+		// exception processing
+		if (srcNum < 0)
+			throw valueException(srcNum);
+		else if (desNum < 0)
+			throw valueException(desNum);
+
+		int last = lineAwareDijkstra(srcNum, desNum, penalty, scratch);
+		if (last < 0)
+		{
+			if (!scratch.quiet)
+				cout << "Can't arrive!" << endl;
+			throw valueException(INF);
+		}
+
+		METRIC_PHASE(metrics, RECONSTRUCT);
+		stateRoute(scratch, last, scratch.route, scratch.lines);
+		return true;
+	}
+	catch (valueException &ex) { if (!scratch.quiet) { cout << ex.what(); ex.printValue(); cout << endl; } }
+	return false;
+}
+
+// a transfer keeps the station, thus only states at a new station add a station and the line of the section
+void Metro::stateRoute(const QueryScratch &scratch, int last, vector<int> &route, vector<LineSet> &lines)const
+{
+	route.clear();
+	lines.clear();
+	for (int s = last; s >= 0; s = scratch.prev[s])
+	{
+		int prevState = scratch.prev[s];
+		if (prevState >= 0 && net->stateStat[prevState] == net->stateStat[s])
+			continue;
+		route.push_back(net->stateStat[s]);
+		if (prevState >= 0)
+		{
+			LineSet line;
+			line.set(net->stateLine[s]);
+			lines.push_back(line);
+		}
+	}
+	reverse(route.begin(), route.end());
+	reverse(lines.begin(), lines.end());
+}
+
+// rides are walked back from destination, a label kept from the last round means the same station in the last round
+void Metro::raptorRoute(int src, int des, int round, const QueryScratch &scratch, vector<int> &route, vector<LineSet> &lines)const
+{
+	METRIC_PHASE(metrics, RECONSTRUCT);
+	int n = net->graph.size();
+	route.assign(1, des);
+	lines.clear();
+	for (int num = des; round > 0; --round)
+	{
+		size_t label = (size_t)round * n + num;
+		if (scratch.roundBoard[label] < 0)
+			continue;
+		int board = scratch.roundBoard[label], alight = scratch.roundAlight[label];
+		// lines serving every section of the ride
+		LineSet common;
+		common.set(net->patternLine[net->stopPattern[board]]);
+		for (int stop = board; stop < alight; ++stop)
+			common = common & net->graph.lines[net->graph.findEdge(net->patternStat[stop], net->patternStat[stop + 1])];
+		for (int stop = alight - 1; stop >= board; --stop)
+		{
+			route.push_back(net->patternStat[stop]);
+			lines.push_back(common);
+		}
+		num = net->patternStat[board];
+	}
+	reverse(route.begin(), route.end());
+	reverse(lines.begin(), lines.end());
+	if (src == des)
+		route.assign(1, src);
+}
+
+// get the shortest route by RAPTOR, the last route of the Pareto set is the shortest one and has the fewest transfers among them
+bool Metro::raptorSearchRoute(const string &src, const string &des, QueryScratch &scratch)const throw(valueException)
+{
+	try
+	{
+		// get number by station's name
+		int srcNum = searchStatNum(src), desNum = searchStatNum(des);
+
+		// exception processing
+		if (srcNum < 0)
+			throw valueException(srcNum);
+		else if (desNum < 0)
+			throw valueException(desNum);
+
+		int rounds = raptor(srcNum, desNum, scratch);
+		vector<int> pareto;
+		paretoRounds(desNum, rounds, scratch, pareto);
+		if (pareto.empty() && srcNum != desNum)
+		{
+			if (!scratch.quiet)
+				cout << "Can't arrive!" << endl;
+			throw valueException(INF);
+		}
+
+		raptorRoute(srcNum, desNum, pareto.empty() ? 0 : pareto.back(), scratch, scratch.route, scratch.lines);
+		return true;
+	}
+	catch (valueException &ex) { if (!scratch.quiet) { cout << ex.what(); ex.printValue(); cout << endl; } }
+	return false;
+}
+
+// get availbale routes along the shortest path (maybe more than 1)
+// shortPath is the whole shortest route (including all passed stations) that we get by function searchRoute
+// posRout records the result, posRout[i] is the set of lines between shortPath[i] and shortPath[i + 1]
+void Metro::availableRoute(const int *shortPath, int routeLen, vector<LineSet> &posRout)const
+{
+	posRout.clear();
+	// when bestRout is null then stop
+	if (shortPath == nullptr)
+		return;
+
+	// the total of stations is always one more than routes
+	// for example, from A to B we take Route 2, there're 2 stations and 1 (1 = 2 - 1) route
+	for (int i = 1; i < routeLen; ++i)
+		// search the edge between the two stations in the graph, and push its lines into the result
+		posRout.push_back(net->graph.lines[net->graph.findEdge(shortPath[i - 1], shortPath[i])]);
+}
+
+// compute the "best route" by the available routes that we get from the above function
+// there may be 2 or more "best routes", and they'll be completely included in result
+// the result is written back into myRout, since resRout[i] only depends on myRout[0] ... myRout[i]
+void Metro::bestRoutSelect(vector<LineSet> &myRout)const
+{
+	// when empty, then stop
+	if (myRout.size() == 0)
+		return;
+
+	// preRout means the former route, and sufRout means the latter one
+	LineSet preRout = myRout[0], sufRout;
+
+	// screen out the best routes
+	for (int cur = 1; cur < (int)myRout.size(); ++cur)
+	{
+		sufRout = myRout[cur];
+
+		// "temp" and "next" are used to record which available routes exist both in the former available routes and the latter available routes
+		// here we use "temp" to store the current ones, and use "next" to store the next ones
+		LineSet temp = preRout & sufRout, next = temp;
+
+		// when temp is empty (no same route), then transfer, just keep sufRout
+		if (!temp.none())
+		{
+			// we put temp into resRout, and resIter is the position
+			int resIter = cur;
+			myRout[cur] = temp;
+
+			// search the longest common route
+			while (!next.none() && resIter >= 1)
+			{
+				temp = next;
+				next = temp & myRout[resIter];
+				--resIter;
+			}
+
+			// adjustment details
+			if (next.none())
+				resIter += 2;
+			else
+			{
+				temp = next;
+				next = temp & myRout[resIter];
+				if (!next.none())
+					temp = next;
+				else
+					++resIter;
+			}
+
+			// assign the longest common route to relevant members of resRout
+			for (; resIter <= cur; ++resIter)
+				myRout[resIter] = temp;
+		}
+		// the latter member will become the former one
+		preRout = sufRout;
+	}
+}
+
+// sub-function of userAPI, mainly for searching and printing out best route
+void Metro::userSearch()throw(valueException)
+{
+	string src, des; // source station name and destination station name
+	cout << endl << "Now input your source:" << endl; cin >> src;
+	cout << endl << "Next input your destination:" << endl; cin >> des;
+
+	// search for the whole shortest path and the best lines
+	vector<int> &route = userScratch.route;
+	vector<LineSet> &best = userScratch.lines;
+	findRoute(src, des, userScratch);
+
+	// print result out
+	printRoute(route.data(), route.size(), best);
+
+	// some more details, including total distance, names of passed stations and their distance
+	cout << endl << endl << "Would like to see all details about passing stations? (y/n)" << endl;
+	char flag; cin >> flag;
+	try
+	{
+		if (flag == 'y')
+			// print out details
+			printDetails(route.data(), route.size());
+		else if (flag != 'n')
+			throw valueException(flag);
+	}
+	catch (valueException &ex) { cout << ex.what(); ex.printValue(); cout << endl; }
+}
+
+bool Metro::findRoute(const string &src, const string &des, QueryScratch &scratch)const throw(valueException)
+{
+	vector<int> &route = scratch.route;
+	bool found;
+#if METRICS
+	chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+	scratch.settled = scratch.relaxed = scratch.allocations = 0;
+#endif
+	{
+		METRIC_PHASE(metrics, SEARCH);
+		// if you've chosen Dijkstra algorithm
+		if (alg == 'd')
+			found = heapSearchRoute(src, des, route, scratch);
+		else if (alg == 's' && !indexStale())
+			found = skeletonSearchRoute(src, des, route, scratch);
+		else if (alg == 'c' && !indexStale())
+			found = hierarchySearchRoute(src, des, route, scratch);
+		// bidirectional Dijkstra stands in for the hierarchy or the skeleton dropped by a change until it's built again
+		else if (alg == 'b' || alg == 'c' || alg == 's')
+			found = bidirectionalSearchRoute(src, des, route, scratch);
+		// line-aware Dijkstra has chosen lines already
+		else if (alg == 'l')
+			found = lineAwareSearchRoute(src, des, transferPenalty, scratch);
+		// so has RAPTOR
+		else if (alg == 'r')
+			found = raptorSearchRoute(src, des, scratch);
+		else
+			found = searchRoute(src, des, route, scratch);
+	}
+	// if result is empty, then throw exception
+	if (!found)
+	{
+#if METRICS
+		countQuery(scratch, 0, chrono::steady_clock::now() - begin);
+#endif
+		if (!scratch.quiet)
+			cout << "Illegal location!" << endl;
+		throw valueException(src + " " + des);
+	}
+
+	// compute available and then best routes
+	if (alg != 'l' && alg != 'r')
+	{
+		METRIC_PHASE(metrics, LINES);
+		availableRoute(route.data(), route.size(), scratch.lines);
+		bestRoutSelect(scratch.lines);
+	}
+#if METRICS
+	countQuery(scratch, route.size(), chrono::steady_clock::now() - begin);
+#endif
+	return found;
+}
+
+void Metro::countQuery(const QueryScratch &scratch, int routeLen, chrono::steady_clock::duration time)const
+{
+	metrics.add(MetroMetrics::QUERIES, 1);
+	metrics.add(routeLen > 0 ? MetroMetrics::ROUTE_STATIONS : MetroMetrics::FAILED, routeLen > 0 ? routeLen : 1);
+	metrics.add(MetroMetrics::SETTLED, scratch.settled);
+	metrics.add(MetroMetrics::RELAXED, scratch.relaxed);
+	metrics.add(MetroMetrics::ALLOCATIONS, scratch.allocations);
+	metrics.addLatency(time);
+}
+
+// sub-function of userSearch, used to print routes
+void Metro::printRoute(int *route, int routeLen, const vector<LineSet> &best)
+{
+	cout << endl << "The best route is:" << endl;
+	printSections(route, routeLen, best);
+}
+
+void Metro::printSections(int *route, int routeLen, const vector<LineSet> &best)
+{
+	int cursorStat = 1; // a cursor used to print station and route (cursorStat - 1)
+	cout << "Station: " << net->stat[route[0]].name;
+
+	while (cursorStat < routeLen)
+	{
+		// search for transfer station
+		while (cursorStat < routeLen - 1 && best[cursorStat - 1] == best[cursorStat])
+			++cursorStat;
+
+		// then print out name of route and transfer station
+		int line = best[cursorStat - 1].next(0);
+		cout << " -> Route: " << net->lineNames.name(line);
+		for (line = best[cursorStat - 1].next(line + 1); line >= 0; line = best[cursorStat - 1].next(line + 1))
+			cout << " or " << net->lineNames.name(line); // there may be more than one best route
+		cout << " -> Station: " << net->stat[route[cursorStat]].name;
+
+		++cursorStat;
+	}
+}
+
+// sub-function of userAPI, searches at most k shortest routes and prints them one by one
+void Metro::userAlternatives()throw(valueException)
+{
+	string src, des; // source station name and destination station name
+	int k;
+	cout << endl << "Now input your source:" << endl; cin >> src;
+	cout << endl << "Next input your destination:" << endl; cin >> des;
+	cout << endl << "How many routes at most?" << endl; cin >> k;
+	int srcNum = searchStatNum(src), desNum = searchStatNum(des);
+	if (srcNum < 0)
+		throw valueException(src);
+	if (desNum < 0)
+		throw valueException(des);
+
+	vector<Candidate> routes;
+	kShortestRoutes(srcNum, desNum, k, routes, userScratch);
+	if (routes.empty())
+	{
+		cout << "Can't arrive!" << endl;
+		return;
+	}
+	for (int i = 0; i < (int)routes.size(); ++i)
+	{
+		availableRoute(routes[i].route.data(), routes[i].route.size(), userScratch.lines);
+		bestRoutSelect(userScratch.lines);
+		cout << endl << "Route " << i + 1 << ": " << routes[i].distance << " m, " << transferCount(userScratch.lines) << " transfers" << endl;
+		printSections(routes[i].route.data(), routes[i].route.size(), userScratch.lines);
+		cout << endl;
+	}
+}
+
+// sub-function of userAPI, searches routes by RAPTOR and prints them from the fewest transfers to the shortest
+void Metro::userPareto()throw(valueException)
+{
+	string src, des; // source station name and destination station name
+	cout << endl << "Now input your source:" << endl; cin >> src;
+	cout << endl << "Next input your destination:" << endl; cin >> des;
+	int srcNum = searchStatNum(src), desNum = searchStatNum(des);
+	if (srcNum < 0)
+		throw valueException(src);
+	if (desNum < 0)
+		throw valueException(des);
+
+	vector<int> pareto;
+	paretoRounds(desNum, raptor(srcNum, desNum, userScratch), userScratch, pareto);
+	if (pareto.empty())
+	{
+		cout << (srcNum == desNum ? "You're there already." : "Can't arrive!") << endl;
+		return;
+	}
+	for (int i = 0; i < (int)pareto.size(); ++i)
+	{
+		raptorRoute(srcNum, desNum, pareto[i], userScratch, userScratch.route, userScratch.lines);
+		cout << endl << "Route " << i + 1 << ": " << userScratch.roundDis[(size_t)pareto[i] * net->graph.size() + desNum] << " m, "
+			<< transferCount(userScratch.lines) << " transfers" << endl;
+		printSections(userScratch.route.data(), userScratch.route.size(), userScratch.lines);
+		cout << endl;
+	}
+}
+
+// sub-function of userAPI, searches the earliest arrival by Connection Scan, and prints times of leaving and transfers
+void Metro::userDepart()throw(valueException)
+{
+	string src, des, time; // source station name, destination station name and the time of leaving
+	cout << endl << "Now input your source:" << endl; cin >> src;
+	cout << endl << "Next input your destination:" << endl; cin >> des;
+	cout << endl << "When do you leave? (h:mm)" << endl; cin >> time;
+	if (searchStatNum(src) < 0)
+		throw valueException(src);
+	if (searchStatNum(des) < 0)
+		throw valueException(des);
+	int departure = clockSeconds(time.data(), time.size());
+	if (departure < 0)
+		throw valueException(time);
+	if (!hasTimetable())
+	{
+		cout << "No timetable in the file!" << endl;
+		return;
+	}
+
+	Journey journey;
+	if (!earliestArrival(src, des, departure, journey))
+	{
+		cout << "Can't arrive today!" << endl;
+		return;
+	}
+	if (journey.lines.empty())
+	{
+		cout << "You're there already." << endl;
+		return;
+	}
+	cout << endl << "Leave at " << clockText(journey.departure) << " and arrive at " << clockText(journey.arrival)
+		<< ", " << journey.transfers << " transfers" << endl;
+	cout << "Station: " << journey.stations[0] << " (" << clockText(journey.times[0]) << ")";
+	for (int i = 0; i < (int)journey.lines.size(); ++i)
+		if (i + 1 == (int)journey.lines.size() || journey.lines[i] != journey.lines[i + 1])
+			cout << " -> Route: " << journey.lines[i][0] << " -> Station: " << journey.stations[i + 1] << " (" << clockText(journey.times[i + 1]) << ")";
+	cout << endl;
+}
+
+// sub-function of userSearch, used to print details
+void Metro::printDetails(int *route, int routeLen)
+{
+	// total distance from source to destination, summed up along the route
+	double dis = 0;
+	for (int i = 0; i < routeLen - 1; ++i)
+		dis += edgeWeight()[net->graph.findEdge(route[i], route[i + 1])];
+
+	// print out total distance
+	cout << endl << "Total distance: (calculated by m)" << endl;
+	cout << dis << endl;
+
+	// print out names of passed stations
+	cout << endl << "Names of passing stations:" << endl;
+	for_each(route, route + routeLen - 1, [&](int x) {cout << getStatName(x) << " -> "; });
+	cout << getStatName(route[routeLen - 1]) << endl;
+
+	// print out distance between two adjacent stations in the above passed stations
+	if (routeLen < 2)
+		return;
+	cout << endl << "Distance of passing routes: (calculated by m)" << endl;
+	for (int i = 0; i < routeLen - 2; ++i)cout << edgeWeight()[net->graph.findEdge(route[i], route[i + 1])] << " -> ";
+	cout << edgeWeight()[net->graph.findEdge(route[routeLen - 2], route[routeLen - 1])] << endl;
+}
+
+// constructors
+// vectors have built-in copy/move constructors and destructors
+Metro::Metro(const string &src) : fileSrc(src)
+{
+	alg = 'd';
+	useTables(nullptr);
+	tableAlg = 0;
+	transferPenalty = TRANSFER_PENALTY;
+}
+
+// the network, the changes, the indexes and the tables are all shared, thus a copy only bumps their counts
+Metro::Metro(const Metro &a) : fileSrc(a.fileSrc), alg(a.alg), hierarchy(a.hierarchy), skeleton(a.skeleton), transferPenalty(a.transferPenalty),
+	net(a.net), changes(a.changes), metrics(a.metrics)
+{
+	useTables(a.tables);
+	tableAlg = a.tableAlg;
+	// counters of the caches go on like the other counters, though the trees aren't copied
+	treeCache.hits = a.treeCache.hits.load();
+	treeCache.misses = a.treeCache.misses.load();
+	targetCache.hits = a.targetCache.hits.load();
+	targetCache.misses = a.targetCache.misses.load();
+}
+
+Metro::Metro(Metro &&a) : fileSrc(move(a.fileSrc)), alg(a.alg), hierarchy(move(a.hierarchy)), skeleton(move(a.skeleton)),
+	transferPenalty(a.transferPenalty), net(move(a.net)), changes(move(a.changes)), metrics(a.metrics)
+{
+	useTables(move(a.tables));
+	a.useTables(nullptr);
+	tableAlg = a.tableAlg;
+	treeCache.hits = a.treeCache.hits.load();
+	treeCache.misses = a.treeCache.misses.load();
+	targetCache.hits = a.targetCache.hits.load();
+	targetCache.misses = a.targetCache.misses.load();
+}
+
+// user API function
+void Metro::userAPI(const char *snapSrc)
+{
+	// instructions
+	cout << "Welcome to Metro Route System!" << endl << "Our system helps to calculate the best route from source to destination." << endl;
+	cout << endl << "Commands list:" << endl;
+	cout << "search - Search for best route between two stations." << endl;
+	cout << "cache - Show hits and misses of the shortest path tree cache (Dijkstra only)." << endl;
+	cout << "alternatives - Search for several shortest routes between two stations, which differ in stations." << endl;
+	cout << "pareto - Search for routes between two stations, each with fewer transfers or shorter than the others." << endl;
+	cout << "depart - Search for the earliest arrival between two stations leaving at a time, by timetables in the file." << endl;
+	cout << "metrics - Show time spent in each phase and counters of searches in JSON." << endl;
+	cout << "exit - Leave the Metro Route System." << endl;
+
+	// read data from txt, or from a binary snapshot
+	try { load(snapSrc); }
+	catch (valueException &ex) { cout << ex.what(); ex.printValue(); cout << endl; return; }
+
+	// tables loaded from the snapshot are used directly
+	if (tableAlg != 0)
+	{
+		alg = tableAlg;
+		cout << endl << "Tables computed by algorithm " << alg << " loaded from snapshot." << endl;
+	}
+	// or else choose your algorithm
+	else
+	{
+		cout << endl << "Choose algorithm: Dijkstra, Floyd, parallel Dijkstra for all pairs, line-aware, bidirectional Dijkstra, contraction hierarchies, skeleton of transfer stations or RAPTOR? (d/f/p/l/b/c/s/r)" << endl; cin >> alg;
+		try
+		{
+			if (alg == 'l')
+			{
+				cout << endl << "Input the penalty of a transfer: (calculated by m)" << endl; cin >> transferPenalty;
+				if (!cin || transferPenalty < 0)
+				{
+					cin.clear();
+					transferPenalty = TRANSFER_PENALTY;
+					throw valueException(transferPenalty);
+				}
+			}
+			buildEngine(true);
+		}
+		catch (valueException &ex) { cout << ex.what(); ex.printValue(); cout << endl; }
+	}
+
+	// input your command
+	string command;
+	cout << endl << "Your command:" << endl; cin >> command;
+
+	// command processing
+	while (command != "exit")
+	{
+		if (command == "search")
+		{
+			try { userSearch(); }
+			catch (valueException &ex) { cout << ex.what(); ex.printValue(); cout << endl; }
+		}
+		else if (command == "cache")
+			cout << endl << "Shortest path tree cache: " << treeCache.hits << " hits, " << treeCache.misses << " misses, "
+				<< treeCache.trees.size() << " trees cached (at most " << TREE_CACHE_SIZE << ")" << endl;
+		else if (command == "alternatives")
+		{
+			try { userAlternatives(); }
+			catch (valueException &ex) { cout << ex.what(); ex.printValue(); cout << endl; }
+		}
+		else if (command == "pareto")
+		{
+			try { userPareto(); }
+			catch (valueException &ex) { cout << ex.what(); ex.printValue(); cout << endl; }
+		}
+		else if (command == "depart")
+		{
+			try { userDepart(); }
+			catch (valueException &ex) { cout << ex.what(); ex.printValue(); cout << endl; }
+		}
+		else if (command == "metrics")
+		{
+			cout << endl;
+			getMetrics().writeJson(cout);
+			cout << endl;
+		}
+		else
+			cout << endl << "Invalid command." << endl;
+
+		// input command again until you input "exit"
+		cout << endl << "Your command:" << endl; cin >> command;
+	}
+}
+
+void Metro::buildEngine(bool verbose)throw(valueException)
+{
+	if (alg == 'f')
+	{
+		// Floyd algorithm takes more time to initialize, thus you may have to wait for a while
+		if (verbose)
+			cout << endl << "Loading... Please wait for a few seconds." << endl;
+		Floyd();
+		if (verbose)
+			cout << endl << "Loading Floyd algorithm complete." << endl;
+	}
+	else if (alg == 'p')
+	{
+		if (verbose)
+			cout << endl << "Loading... Please wait for a few seconds." << endl;
+		allPairsDijkstra();
+		if (verbose)
+			cout << endl << "Loading parallel Dijkstra algorithm complete." << endl;
+	}
+	else if (alg == 'l')
+	{
+		METRIC_PHASE(metrics, STATE_GRAPH);
+		editNetwork().buildStateGraph();
+		// the state graph follows closures and distances made before it's built
+		if (changes)
+		{
+			Changes &next = editChanges();
+			next.stateWeight.resize(net->stateGraph.weight.size());
+			for (int s = 0; s < (int)net->stateStat.size(); ++s)
+				for (int k = net->stateGraph.offset[s]; k < net->stateGraph.offset[s + 1]; ++k)
+					next.stateWeight[k] = next.weight[net->graph.findEdge(net->stateStat[s], net->stateStat[net->stateGraph.target[k]])];
+		}
+	}
+	else if (alg == 'c')
+	{
+		if (verbose)
+			cout << endl << "Loading... Please wait for a few seconds." << endl;
+		contractHierarchy();
+		if (verbose)
+			cout << endl << "Loading contraction hierarchies complete." << endl;
+	}
+	else if (alg == 's')
+	{
+		buildSkeleton();
+		if (verbose)
+			cout << endl << "Skeleton of " << skeleton->size() << " stations out of " << net->graph.size() << ", tables take "
+				<< (size_t)skeleton->size() * skeleton->size() * (sizeof(double) + sizeof(int)) / 1024 << " KB instead of "
+				<< (size_t)net->graph.size() * net->graph.size() * (sizeof(double) + sizeof(int)) / 1024 << " KB." << endl;
+	}
+	else if (alg != 'd' && alg != 'b' && alg != 'r')
+	{
+		alg = 'd'; // default: dijkstra
+		throw valueException(alg);
+	}
+}
+
+void Metro::prepare(char engine, const char *snapSrc)throw(valueException)
+{
+	load(snapSrc);
+	build(engine);
+}
+
+void Metro::load(const char *snapSrc)throw(valueException)
+{
+	METRIC_PHASE(metrics, LOAD);
+	loadData(snapSrc);
+	// bidirectional Dijkstra and alternative routes walk edges backwards, and RAPTOR gives the Pareto set, whichever engine is chosen
+	Network &nw = editNetwork();
+	nw.buildReverseGraph();
+	nw.buildPatterns();
+}
+
+void Metro::build(char engine)throw(valueException)
+{
+	// tables loaded from the snapshot are used directly
+	if (tableAlg != 0)
+	{
+		alg = tableAlg;
+		return;
+	}
+	alg = engine;
+	buildEngine(false);
+}
+
+// every thread has its own scratch memory, thus a query never waits for another
+double Metro::search(const string &src, const string &des, vector<string> &stations, vector<vector<string>> *lines)const
+{
+	QueryScratch &scratch = threadScratch();
+	scratch.quiet = true;
+	stations.clear();
+	if (lines != nullptr)
+		lines->clear();
+	// unknown names are the common failure, they're answered without messages of the interactive interface
+	if (searchStatNum(src) < 0 || searchStatNum(des) < 0)
+		return INF;
+	try { findRoute(src, des, scratch); }
+	catch (valueException&) { return INF; }
+
+	double distance = 0;
+	for (int i = 0; i < (int)scratch.route.size(); ++i)
+	{
+		stations.push_back(getStatName(scratch.route[i]));
+		if (i > 0)
+			distance += edgeWeight()[net->graph.findEdge(scratch.route[i - 1], scratch.route[i])];
+	}
+	for (int i = 0; lines != nullptr && i < (int)scratch.lines.size(); ++i)
+	{
+		lines->push_back(vector<string>());
+		for (int line = scratch.lines[i].next(0); line >= 0; line = scratch.lines[i].next(line + 1))
+			lines->back().push_back(net->lineNames.name(line));
+	}
+	return distance;
+}
+
+vector<string> Metro::stationNames()const
+{
+	vector<string> names;
+	for (int i = 0; i < (int)net->stat.size(); ++i)
+		names.push_back(getStatName(i));
+	return names;
+}
+
+// bytes held by a vector, by its capacity
+template<typename T>
+static size_t vectorBytes(const vector<T> &v)
+{
+	return v.capacity() * sizeof(T);
+}
+
+size_t Metro::memoryUsage()const
+{
+	const Graph *graphs[] = { &net->graph, &net->reverseGraph, &net->stateGraph, skeleton ? &skeleton->graph : nullptr };
+	size_t bytes = 0;
+	for (int i = 0; i < 4; ++i)
+		if (graphs[i] != nullptr)
+			bytes += vectorBytes(graphs[i]->offset) + vectorBytes(graphs[i]->target) + vectorBytes(graphs[i]->weight) + vectorBytes(graphs[i]->lines);
+	if (hierarchy)
+		bytes += vectorBytes(hierarchy->rank) + vectorBytes(hierarchy->edges) + vectorBytes(hierarchy->upOff) + vectorBytes(hierarchy->up)
+			+ vectorBytes(hierarchy->downOff) + vectorBytes(hierarchy->down);
+	if (skeleton)
+		bytes += vectorBytes(skeleton->num) + vectorBytes(skeleton->stat) + vectorBytes(skeleton->chainOf) + vectorBytes(skeleton->chainPos)
+			+ vectorBytes(skeleton->chainOff) + vectorBytes(skeleton->chainStat) + vectorBytes(skeleton->fwd) + vectorBytes(skeleton->bwd)
+			+ vectorBytes(skeleton->fwdBroken) + vectorBytes(skeleton->bwdBroken) + vectorBytes(skeleton->edgeChain)
+			+ vectorBytes(skeleton->dis) + vectorBytes(skeleton->prev);
+	bytes += vectorBytes(net->statStateOff) + vectorBytes(net->stateStat) + vectorBytes(net->stateLine);
+	bytes += vectorBytes(net->patternOff) + vectorBytes(net->patternLine) + vectorBytes(net->patternStat) + vectorBytes(net->patternEdge)
+		+ vectorBytes(net->patternDis) + vectorBytes(net->patternCut) + vectorBytes(net->stopPattern) + vectorBytes(net->edgeStopOff) + vectorBytes(net->edgeStop)
+		+ vectorBytes(net->statStopOff) + vectorBytes(net->statStop);
+	bytes += vectorBytes(net->connections);
+	if (changes)
+		bytes += vectorBytes(changes->weight) + vectorBytes(changes->openWeight) + vectorBytes(changes->closedEdge) + vectorBytes(changes->closedStat)
+			+ vectorBytes(changes->reverseWeight) + vectorBytes(changes->stateWeight) + vectorBytes(changes->patternDis) + vectorBytes(changes->patternCut);
+	// tables mapped from a snapshot are counted as well, though they're shared with the page cache
+	if (compactDis != nullptr)
+		bytes += (size_t)stride * stride * (sizeof(uint32_t) + sizeof(uint16_t)) + stride * (sizeof(uint32_t*) + sizeof(uint16_t*));
+	else if (leastDis != nullptr)
+		bytes += (size_t)stride * stride * (sizeof(double) + sizeof(int)) + stride * (sizeof(double*) + sizeof(int*));
+	if (tables)
+		bytes += vectorBytes(tables->owner);
+	return bytes;
+}
+
+void Metro::loadData(const char *snapSrc)throw(valueException)
+{
+	shared_ptr<Network> next = make_shared<Network>();
+	if (snapSrc == nullptr)
+		next->initFromTxt(fileSrc);
+	else
+		loadSnapshot(*next, snapSrc);
+	net = next;
+	changes.reset();
+}
+
+/*
+* Result line of a query, fields are separated by tabs:
+* no  source  destination  distance  station|station|...  lines|lines|...
+* "no" is the number of the query in the file, since results are grouped by source station instead of the order of queries.
+* Alternative lines of a section are separated by '/'. Distance is "unknown" or "inf" when the query fails, and the rest is empty.
+*/
+void Metro::batchGroup(const BatchQuery *query, int count, ostream &out)const
+{
+	QueryScratch &scratch = threadScratch();
+	int src = query[0].src;
+#if METRICS
+	scratch.settled = scratch.relaxed = scratch.allocations = 0;
+#endif
+	if (src >= 0)
+	{
+		METRIC_PHASE(metrics, SEARCH);
+		heapDijkstra(src, -1, scratch);
+	}
+	// the search is shared by the group, thus counted once, and latency of queries isn't recorded in batch mode
+	METRIC_COUNT(metrics, QUERIES, count);
+	METRIC_COUNT(metrics, SETTLED, scratch.settled);
+	METRIC_COUNT(metrics, RELAXED, scratch.relaxed);
+	METRIC_COUNT(metrics, ALLOCATIONS, scratch.allocations);
+
+	out.precision(15);
+	for (int q = 0; q < count; ++q)
+	{
+		out << query[q].no << '\t' << query[q].srcName << '\t' << query[q].desName << '\t';
+		int des = query[q].des;
+		if (src < 0 || des < 0)
+		{
+			METRIC_COUNT(metrics, FAILED, 1);
+			out << "unknown\t\t\n";
+			continue;
+		}
+		if (scratch.getDis(des) == INF)
+		{
+			METRIC_COUNT(metrics, FAILED, 1);
+			out << "inf\t\t\n";
+			continue;
+		}
+
+		{
+			METRIC_PHASE(metrics, RECONSTRUCT);
+			treeRoute(scratch.prev.data(), des, scratch.route);
+		}
+		{
+			METRIC_PHASE(metrics, LINES);
+			availableRoute(scratch.route.data(), scratch.route.size(), scratch.lines);
+			bestRoutSelect(scratch.lines);
+		}
+		METRIC_COUNT(metrics, ROUTE_STATIONS, scratch.route.size());
+		out << scratch.getDis(des) << '\t';
+		for (int i = 0; i < (int)scratch.route.size(); ++i)
+			out << (i > 0 ? "|" : "") << net->stat[scratch.route[i]].name;
+		out << '\t';
+		for (int i = 0; i < (int)scratch.lines.size(); ++i)
+		{
+			out << (i > 0 ? "|" : "") << net->lineNames.name(scratch.lines[i].next(0));
+			for (int line = scratch.lines[i].next(scratch.lines[i].next(0) + 1); line >= 0; line = scratch.lines[i].next(line + 1))
+				out << '/' << net->lineNames.name(line);
+		}
+		out << '\n';
+	}
+}
+
+void Metro::batchAPI(const string &querySrc, const char *snapSrc)
+{
+	try
+	{
+		load(snapSrc);
+
+		ifstream file;
+		if (querySrc != "-")
+		{
+			file.open(querySrc);
+			if (!file)
+			{
+				cout << "Invalid file directory!" << endl;
+				throw valueException(querySrc);
+			}
+		}
+		istream &in = querySrc == "-" ? cin : file;
+
+		chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+		// read all queries, and sort them by source station, queries from the same station keep their order
+		vector<BatchQuery> query;
+		BatchQuery temp;
+		while (in >> temp.srcName >> temp.desName)
+		{
+			temp.no = query.size() + 1;
+			temp.src = searchStatNum(temp.srcName);
+			temp.des = searchStatNum(temp.desName);
+			query.push_back(temp);
+		}
+		stable_sort(query.begin(), query.end(), [](const BatchQuery &a, const BatchQuery &b) { return a.src < b.src; });
+
+		// groups[g] is the first query of the g-th source station
+		vector<int> groups;
+		for (int q = 0; q < (int)query.size(); ++q)
+			if (q == 0 || query[q].src != query[q - 1].src)
+				groups.push_back(q);
+		groups.push_back(query.size());
+
+		// a window of source stations is computed in parallel, then their results are written in order
+		int groupNum = groups.size() - 1;
+		vector<ostringstream> result(min(groupNum, BATCH_WINDOW));
+		for (int first = 0; first < groupNum; first += BATCH_WINDOW)
+		{
+			int windowSize = min(BATCH_WINDOW, groupNum - first);
+			parallelFor(windowSize, [&](int g) {
+				result[g].str("");
+				batchGroup(&query[groups[first + g]], groups[first + g + 1] - groups[first + g], result[g]);
+			});
+			for (int g = 0; g < windowSize; ++g)
+				cout << result[g].str();
+		}
+		cout.flush();
+
+		// throughput is reported to standard error, so that standard output only contains results
+		double seconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+		cerr << query.size() << " queries from " << groupNum << " source stations in " << seconds << " s, "
+			<< (seconds > 0 ? query.size() / seconds : 0) << " queries per second" << endl;
+	}
+	catch (valueException &ex) { cout << ex.what(); ex.printValue(); cout << endl; }
+}
+
+// read station names separated by spaces or lines from a file, or standard input for "-"
+static vector<string> readNames(const string &src)throw(valueException)
+{
+	ifstream file;
+	if (src != "-")
+	{
+		file.open(src);
+		if (!file)
+		{
+			cout << "Invalid file directory!" << endl;
+			throw valueException(src);
+		}
+	}
+	istream &in = src == "-" ? cin : file;
+	vector<string> names;
+	string name;
+	while (in >> name)
+		names.push_back(name);
+	return names;
+}
+
+/*
+* The distance table is written by tabs, the first line is the targets after an empty field,
+* and then a line of each source: its name and the distances to the targets, "unknown" or "inf" when it fails.
+*/
+void Metro::tableAPI(const string &srcFile, const string &desFile, const char *snapSrc)
+{
+	try
+	{
+		load(snapSrc);
+		vector<string> sources = readNames(srcFile), targets = readNames(desFile);
+
+		chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+		vector<double> table = distanceTable(sources, targets);
+		double seconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+
+		ostringstream out;
+		out.precision(15);
+		for (int t = 0; t < (int)targets.size(); ++t)
+			out << '\t' << targets[t];
+		out << '\n';
+		for (int s = 0; s < (int)sources.size(); ++s)
+		{
+			out << sources[s];
+			for (int t = 0; t < (int)targets.size(); ++t)
+			{
+				out << '\t';
+				if (!hasStation(sources[s]) || !hasStation(targets[t]))
+					out << "unknown";
+				else if (table[(size_t)s * targets.size() + t] == INF)
+					out << "inf";
+				else
+					out << table[(size_t)s * targets.size() + t];
+			}
+			out << '\n';
+		}
+		cout << out.str();
+		cout.flush();
+		// time is reported to standard error, so that standard output only contains the table
+		cerr << sources.size() << " x " << targets.size() << " distances in " << seconds << " s" << endl;
+	}
+	catch (valueException &ex) { cout << ex.what(); ex.printValue(); cout << endl; }
+}
+
+// a line of each station within the distance: its name and distance, separated by a tab, the nearest first
+void Metro::isochroneAPI(const string &src, double radius, const char *snapSrc)
+{
+	try
+	{
+		load(snapSrc);
+		if (!hasStation(src))
+			throw valueException(src);
+		vector<string> stations;
+		vector<double> dis;
+		isochrone(src, radius, stations, dis);
+		ostringstream out;
+		out.precision(15);
+		for (int i = 0; i < (int)stations.size(); ++i)
+			out << stations[i] << '\t' << dis[i] << '\n';
+		cout << out.str();
+	}
+	catch (valueException &ex) { cout << ex.what(); ex.printValue(); cout << endl; }
+}
+
+void Metro::makeSnapshot(const string &snapSrc, char snapAlg)
+{
+	try
+	{
+		loadData(nullptr);
+		if (snapAlg == 'f')
+			Floyd();
+		else if (snapAlg == 'p')
+			allPairsDijkstra();
+		else if (snapAlg == 'c')
+			contractHierarchy();
+		saveSnapshot(snapSrc);
+		cout << "Snapshot written to " << snapSrc << endl;
+	}
+	catch (valueException &ex) { cout << ex.what(); ex.printValue(); cout << endl; }
+}
+
+/*
+* Engines of many cities, each one is loaded once and never changed after, thus it's shared by all threads without locks.
+* A city is named after its txt file without directory and extension, like "Beijing" for "data/Beijing.txt".
+*/
+class MetroRegistry
+{
+private:
+	unordered_map<string, shared_ptr<const Metro>> cities;
+	// txt file and engine of each city, for reloads
+	unordered_map<string, pair<string, char>> sources;
+	// changes of the same city are applied one by one
+	mutex updateLock;
+	// number of rebuilds running on their own threads, the destructor waits for them
+	int rebuilding;
+	// cities whose rebuild is running, true if the city has been changed again since the rebuild took its engine
+	unordered_map<string, bool> rebuildAgain;
+	mutex rebuildLock;
+	condition_variable rebuildDone;
+	// build the hierarchy or the skeleton dropped by changes (see Metro::applyChange) on another thread,
+	// then swap the engine with it in, unless the city has been changed again meanwhile
+	// a city has one rebuild at most, which starts again from the latest engine as long as changes keep coming
+	void rebuildIndex(const string&);
+public:
+	MetroRegistry() : rebuilding(0) {}
+	~MetroRegistry();
+
+	// load txt files in parallel, one thread for each city, and prepare the algorithm chosen for every city
+	// a city which fails to load is left out
+	void load(const vector<string>&, char);
+	// return the engine of a city, or nullptr if not loaded
+	shared_ptr<const Metro> find(const string&)const;
+	// apply a change line, and return an empty string if succeeded, or the reason if failed:
+	// close/open <city> <station>, close/open <city> <from> <to>, weight <city> <from> <to> <distance>
+	// a copy of the city is changed and then replaces it, thus queries running on the old one are never disturbed
+	// the hierarchy or the skeleton, which the change drops, is built again in the background and swapped in later
+	string change(const string&);
+	// apply a line of "reload city" in the same way: the txt file of the city is read again and prepared into a new engine,
+	// which then replaces the old one at once, queries holding the old one finish on it and changes made to it are dropped
+	// the old one keeps answering while the new one is built, thus it's usually called on another thread
+	string reload(const string&);
+	// read lines of "city source destination" and write one line per query:
+	// city  source  destination  distance  station|station|...
+	// change lines are applied between queries, and answered by the line followed by "ok" or the reason
+	// reload lines are applied in the background, and answered in the same way once the new engine is in use
+	// a line of "metrics" is answered by counters of all cities in Prometheus text exposition, ended by "# EOF"
+	void serve(istream&, ostream&);
+
+	static string cityName(const string&);
+	// whether a line is a change rather than a query
+	static bool isChange(const string&);
+	static bool isReload(const string &line) { return line.compare(0, 7, "reload ") == 0; }
+	// counters of all cities, in JSON as {"city":{...},...} or in Prometheus text exposition
+	void writeMetrics(ostream&, bool)const;
+};
+
+MetroRegistry::~MetroRegistry()
+{
+	unique_lock<mutex> guard(rebuildLock);
+	rebuildDone.wait(guard, [&]() {return rebuilding == 0; });
+}
+
+string MetroRegistry::cityName(const string &src)
+{
+	size_t begin = src.find_last_of("/\\"), end = src.rfind('.');
+	begin = begin == string::npos ? 0 : begin + 1;
+	return src.substr(begin, end == string::npos || end < begin ? string::npos : end - begin);
+}
+
+void MetroRegistry::load(const vector<string> &srcs, char engine)
+{
+	vector<shared_ptr<Metro>> loaded(srcs.size());
+	vector<thread> threads;
+	for (int i = 0; i < (int)srcs.size(); ++i)
+		threads.push_back(thread([&, i]() {
+			shared_ptr<Metro> city(new Metro(srcs[i]));
+			try
+			{
+				city->prepare(engine);
+				loaded[i] = city;
+			}
+			catch (valueException &ex) { cout << ex.what(); ex.printValue(); cout << endl; }
+		}));
+	for (vector<thread>::iterator iter = threads.begin(); iter != threads.end(); ++iter)
+		(*iter).join();
+
+	for (int i = 0; i < (int)srcs.size(); ++i)
+		if (loaded[i])
+		{
+			cities[cityName(srcs[i])] = loaded[i];
+			sources[cityName(srcs[i])] = make_pair(srcs[i], engine);
+		}
+}
+
+shared_ptr<const Metro> MetroRegistry::find(const string &name)const
+{
+	unordered_map<string, shared_ptr<const Metro>>::const_iterator iter = cities.find(name);
+	return iter == cities.end() ? nullptr : atomic_load(&(*iter).second);
+}
+
+bool MetroRegistry::isChange(const string &line)
+{
+	istringstream in(line);
+	string word;
+	in >> word;
+	return word == "close" || word == "open" || word == "weight";
+}
+
+string MetroRegistry::change(const string &line)
+{
+	istringstream in(line);
+	string word, city, from, to;
+	double weight = 0;
+	in >> word >> city >> from;
+	bool hasTo = (bool)(in >> to);
+	if (word == "weight" && !(in >> weight))
+		return "a weight change needs: weight city from to distance";
+	if (from.empty())
+		return "a closure needs: close/open city station, or close/open city from to";
+
+	lock_guard<mutex> guard(updateLock);
+	unordered_map<string, shared_ptr<const Metro>>::iterator iter = cities.find(city);
+	if (iter == cities.end())
+		return "unknown city";
+	shared_ptr<Metro> metro(new Metro(*atomic_load(&(*iter).second)));
+	bool done;
+	if (word == "weight")
+		done = metro->setSegmentWeight(from, to, weight);
+	else if (hasTo)
+		done = metro->setSegmentClosed(from, to, word == "close");
+	else
+		done = metro->setStationClosed(from, word == "close");
+	if (!done)
+		return word == "weight" && metro->hasStation(from) && metro->hasStation(to) && weight <= 0 ? "bad distance" :
+			(hasTo ? "unknown segment" : "unknown station");
+	atomic_store(&(*iter).second, shared_ptr<const Metro>(metro));
+	if (metro->indexStale())
+		rebuildIndex(city);
+	return "";
+}
+
+void MetroRegistry::rebuildIndex(const string &city)
+{
+	{
+		lock_guard<mutex> guard(rebuildLock);
+		unordered_map<string, bool>::iterator running = rebuildAgain.find(city);
+		if (running != rebuildAgain.end())
+		{
+			running->second = true;
+			return;
+		}
+		rebuildAgain[city] = false;
+		++rebuilding;
+	}
+	thread([this, city]() {
+		// cities are never added or removed after loading, thus the slot stays
+		shared_ptr<const Metro> &slot = cities.find(city)->second;
+		for (;;)
+		{
+			shared_ptr<const Metro> base = atomic_load(&slot);
+			if (base->indexStale())
+			{
+				shared_ptr<Metro> metro(new Metro(*base));
+				metro->rebuildIndex();
+				lock_guard<mutex> guard(updateLock);
+				if (atomic_load(&slot) == base)
+					atomic_store(&slot, shared_ptr<const Metro>(metro));
+			}
+			lock_guard<mutex> guard(rebuildLock);
+			bool &again = rebuildAgain[city];
+			if (again)
+			{
+				again = false;
+				continue;
+			}
+			rebuildAgain.erase(city);
+			--rebuilding;
+			rebuildDone.notify_all();
+			return;
+		}
+	}).detach();
+}
+
+string MetroRegistry::reload(const string &line)
+{
+	istringstream in(line);
+	string word, city;
+	in >> word >> city;
+	unordered_map<string, pair<string, char>>::const_iterator source = sources.find(city);
+	if (source == sources.end())
+		return "unknown city";
+
+	// the new engine is built without the lock, thus changes and queries of every city go on meanwhile
+	shared_ptr<Metro> metro(new Metro(source->second.first));
+	try
+	{
+		metro->prepare(source->second.second);
+	}
+	catch (valueException&)
+	{
+		return "can't load";
+	}
+	lock_guard<mutex> guard(updateLock);
+	atomic_store(&cities[city], shared_ptr<const Metro>(metro));
+	return "";
+}
+
+void MetroRegistry::writeMetrics(ostream &out, bool prometheus)const
+{
+	// engines are held while writing, since they may be replaced by changes at the same time
+	vector<pair<string, shared_ptr<const Metro>>> engines;
+	for (unordered_map<string, shared_ptr<const Metro>>::const_iterator iter = cities.begin(); iter != cities.end(); ++iter)
+		engines.push_back(make_pair(iter->first, atomic_load(&iter->second)));
+	sort(engines.begin(), engines.end());
+
+	vector<pair<string, const MetroMetrics*>> metrics;
+	for (int i = 0; i < (int)engines.size(); ++i)
+		metrics.push_back(make_pair(engines[i].first, &engines[i].second->getMetrics()));
+	if (prometheus)
+	{
+		MetroMetrics::writePrometheus(out, metrics);
+		return;
+	}
+	out << '{';
+	for (int i = 0; i < (int)metrics.size(); ++i)
+	{
+		out << (i > 0 ? "," : "");
+		writeJson(out, metrics[i].first);
+		out << ':';
+		metrics[i].second->writeJson(out);
+	}
+	out << '}';
+}
+
+void MetroRegistry::serve(istream &in, ostream &out)
+{
+	string line, city, src, des;
+	vector<string> stations;
+	// reloads being built, each is answered by the first query line read after it's finished, or at the end
+	deque<pair<string, future<string>>> reloads;
+	auto answerReloads = [&](bool wait) {
+		for (deque<pair<string, future<string>>>::iterator iter = reloads.begin(); iter != reloads.end();)
+			if (wait || iter->second.wait_for(chrono::seconds(0)) == future_status::ready)
+			{
+				string error = iter->second.get();
+				out << iter->first << '\t' << (error.empty() ? "ok" : error) << '\n';
+				iter = reloads.erase(iter);
+			}
+			else
+				++iter;
+	};
+	out.precision(15);
+	while (getline(in, line))
+	{
+		answerReloads(false);
+		if (isChange(line))
+		{
+			string error = change(line);
+			out << line << '\t' << (error.empty() ? "ok" : error) << '\n';
+			continue;
+		}
+		if (isReload(line))
+		{
+			reloads.push_back(make_pair(line, async(launch::async, &MetroRegistry::reload, this, line)));
+			continue;
+		}
+		if (line == "metrics")
+		{
+			writeMetrics(out, true);
+			out << "# EOF\n";
+			continue;
+		}
+		istringstream query(line);
+		if (!(query >> city >> src >> des))
+			continue;
+		out << city << '\t' << src << '\t' << des << '\t';
+		shared_ptr<const Metro> metro = find(city);
+		double distance = metro ? metro->search(src, des, stations) : INF;
+		if (!metro)
+			out << "unknown";
+		else if (distance == INF)
+			out << "inf";
+		else
+			out << distance;
+		out << '\t';
+		for (int i = 0; distance != INF && i < (int)stations.size(); ++i)
+			out << (i > 0 ? "|" : "") << stations[i];
+		out << '\n';
+	}
+	answerReloads(true);
+	out.flush();
+}
+
+/*
+* Synthetic networks in the format of txt files, so that engines can be compared on networks much larger than real cities.
+* Stations are scattered over a square with about 1km between neighbours, and each line runs through the stations nearest to
+* a random center, sorted along a random direction, or around the center for a loop.
+* Lines are first joined into a tree by interchanges, thus the network is connected when there are no one-way segments,
+* and then more stations are shared by nearby lines until the ratio of interchanges is reached.
+*/
+struct NetworkShape
+{
+	int stations = 1000;
+	int lines = 0;           // 0 means about 25 stations for each line, at most MAX_LINE_NUM
+	double interchange = 0.1; // ratio of stations shared by more than one line
+	double loop = 0.05;      // ratio of loop lines
+	double oneWay = 0.02;    // ratio of one-way segments
+	unsigned seed = 1;
+};
+
+class NetworkGenerator
+{
+private:
+	NetworkShape shape;
+	mt19937 random;
+	vector<double> x, y;            // position of each station, calculated by m
+	vector<vector<int>> lineStat;   // stations of each line, not in order yet
+	vector<int> homeLine;           // line whose center is the nearest to each station
+	vector<int> center;             // station at the center of each line
+
+	double distance(int a, int b) const { return sqrt((x[a] - x[b]) * (x[a] - x[b]) + (y[a] - y[b]) * (y[a] - y[b])); }
+	bool onLine(int, int) const;
+	// the station of line "from" nearest to the center of line "to"
+	int nearestStation(int from, int to) const;
+	// lines ordered by the distance between their centers and the center of a line
+	vector<int> nearbyLines(int) const;
+	// put stations of a line in order, and write it in the format of txt files
+	void writeLine(ostream&, int);
+public:
+	NetworkGenerator(const NetworkShape&);
+	// write the network into a txt file, return false if the file can't be written
+	bool write(const string&);
+};
+
+NetworkGenerator::NetworkGenerator(const NetworkShape &s) : shape(s), random(s.seed)
+{
+	int n = max(shape.stations, 2);
+	if (shape.lines <= 0)
+		shape.lines = n / 25;
+	shape.lines = max(1, min(min(shape.lines, MAX_LINE_NUM), n / 2));
+	int lines = shape.lines;
+
+	double side = sqrt((double)n) * 1000;
+	uniform_real_distribution<double> pos(0, side);
+	for (int i = 0; i < n; ++i)
+	{
+		x.push_back(pos(random));
+		y.push_back(pos(random));
+	}
+
+	// every station belongs to the line of the nearest center
+	vector<int> order(n);
+	for (int i = 0; i < n; ++i)
+		order[i] = i;
+	shuffle(order.begin(), order.end(), random);
+	center.assign(order.begin(), order.begin() + lines);
+	lineStat.assign(lines, vector<int>());
+	homeLine.assign(n, 0);
+	for (int i = 0; i < n; ++i)
+	{
+		for (int l = 1; l < lines; ++l)
+			if (distance(i, center[l]) < distance(i, center[homeLine[i]]))
+				homeLine[i] = l;
+		lineStat[homeLine[i]].push_back(i);
+	}
+
+	// join every line to the nearest one joined before, so that lines form a tree
+	int shared = 0;
+	for (int l = 1; l < lines; ++l)
+	{
+		int nearest = 0;
+		for (int k = 1; k < l; ++k)
+			if (distance(center[l], center[k]) < distance(center[l], center[nearest]))
+				nearest = k;
+		lineStat[l].push_back(nearestStation(nearest, l));
+		++shared;
+	}
+	// a line of a single station shares one more from its neighbour
+	for (int l = 0; l < lines; ++l)
+		if (lineStat[l].size() < 2 && lines > 1)
+		{
+			int other = nearbyLines(l)[1];
+			int num = nearestStation(other, l);
+			if (onLine(l, num))
+				num = lineStat[other][0] == num ? lineStat[other].back() : lineStat[other][0];
+			lineStat[l].push_back(num);
+			++shared;
+		}
+
+	// then random stations are shared by one of the three nearest lines
+	for (int tries = 0; shared < shape.interchange * n && lines > 1 && tries < 4 * n; ++tries)
+	{
+		int num = uniform_int_distribution<int>(0, n - 1)(random);
+		vector<int> nearby = nearbyLines(homeLine[num]);
+		int l = nearby[uniform_int_distribution<int>(1, min(3, lines - 1))(random)];
+		if (onLine(l, num))
+			continue;
+		lineStat[l].push_back(num);
+		++shared;
+	}
+}
+
+bool NetworkGenerator::onLine(int l, int num) const
+{
+	return find(lineStat[l].begin(), lineStat[l].end(), num) != lineStat[l].end();
+}
+
+int NetworkGenerator::nearestStation(int from, int to) const
+{
+	int nearest = lineStat[from][0];
+	for (vector<int>::const_iterator iter = lineStat[from].begin(); iter != lineStat[from].end(); ++iter)
+		if (distance(*iter, center[to]) < distance(nearest, center[to]))
+			nearest = *iter;
+	return nearest;
+}
+
+vector<int> NetworkGenerator::nearbyLines(int l) const
+{
+	vector<int> lines(lineStat.size());
+	for (int i = 0; i < (int)lines.size(); ++i)
+		lines[i] = i;
+	sort(lines.begin(), lines.end(), [&](int a, int b) {
+		return distance(center[a], center[l]) < distance(center[b], center[l]);
+	});
+	return lines;
+}
 
-	// recursion stops only when the sequence number of the relay station equals the former station
-	if (pathNum == init[k])
-		return;
+void NetworkGenerator::writeLine(ostream &out, int l)
+{
+	vector<int> &stations = lineStat[l];
+	bool isLoop = stations.size() >= 3 && uniform_real_distribution<double>(0, 1)(random) < shape.loop;
+	double angle = uniform_real_distribution<double>(0, 2 * acos(-1.0))(random);
+	double cx = x[center[l]], cy = y[center[l]];
+	sort(stations.begin(), stations.end(), [&](int a, int b) {
+		if (isLoop)
+			return atan2(y[a] - cy, x[a] - cx) < atan2(y[b] - cy, x[b] - cx);
+		return x[a] * cos(angle) + y[a] * sin(angle) < x[b] * cos(angle) + y[b] * sin(angle);
+	});
+	// a loop ends at the station where it begins
+	if (isLoop)
+		stations.push_back(stations[0]);
 
-	// before insertion, move forward all the elements from the inserted position to the end of the array
-	// by the way, init_len has been defined as a static global variable
-	for (int i = init_len; i > k + 1; --i)
-		init[i] = init[i - 1];
-	// insert to init[k + 1]
-	init[k + 1] = pathNum;
-	// length of the array adds 1
-	++init_len;
+	out << l + 1 << ' ' << (isLoop ? 'y' : 'n') << " S" << stations[0];
+	for (int i = 1; i < (int)stations.size(); ++i)
+	{
+		char direc = 'b';
+		if (uniform_real_distribution<double>(0, 1)(random) < shape.oneWay)
+			direc = random() % 2 ? 'u' : 'd';
+		out << ' ' << max(100, (int)distance(stations[i - 1], stations[i])) << ' ' << direc << " S" << stations[i];
+	}
+	out << '\n';
+}
 
-	// continue recursion
-	routeRecur(init, k);
-	routeRecur(init, init_len - disFromEnd - 1);
+bool NetworkGenerator::write(const string &dst)
+{
+	ofstream out(dst, ios::binary);
+	if (!out)
+		return false;
+	for (int l = 0; l < (int)lineStat.size(); ++l)
+		writeLine(out, l);
+	return (bool)out;
 }
 
-// get availbale routes along the shortest path (maybe more than 1)
-// shortPath is the whole shortest route (including all passed stations) that we get by function searchRoute
-vector<vector<string>> Metro::availableRoute(int *shortPath)
+/*
+* Benchmark of engines on a txt file. Every engine is timed on its own Metro:
+* load time of the txt file, precomputation time, memory held by the graphs and tables, and latency of random queries by search().
+* Engines which would take too long or too much memory on a large network are skipped, as BENCH_FLOYD_LIMIT and BENCH_TABLE_LIMIT say.
+*/
+class MetroBench
 {
-	// when bestRout is null then stop
-	if (shortPath == nullptr)
-		return vector<vector<string>>(0);
+private:
+	static double elapsedMs(chrono::steady_clock::time_point begin)
+	{
+		return chrono::duration<double, milli>(chrono::steady_clock::now() - begin).count();
+	}
+	// latency at a percentile of sorted latencies
+	static double percentile(const vector<double> &sorted, double p)
+	{
+		return sorted[min(sorted.size() - 1, (size_t)(p * sorted.size()))];
+	}
+public:
+	static void printHeader(ostream&);
+	// benchmark engines (a string of d/f/p/b/c/s/l/r) by queries between random stations, and write one line per engine
+	static void run(const string&, const string&, int, ostream&);
+	// path of a file in the temporary directory, where synthetic networks of a benchmark are written
+	static string tempPath(const string&);
+};
 
-	// posRout records the result
-	vector<vector<string>> posRout;
+string MetroBench::tempPath(const string &name)
+{
+#ifdef _WIN32
+	char dir[MAX_PATH + 1];
+	DWORD len = GetTempPathA(sizeof(dir), dir);
+	return (len > 0 && len <= MAX_PATH ? string(dir, len) : string(".\\")) + name;
+#else
+	const char *dir = getenv("TMPDIR");
+	return string(dir != nullptr && *dir != 0 ? dir : "/tmp") + "/" + name;
+#endif
+}
 
-	// preStat means the sequence number of the former station, and sufStat is the latter one
-	// the total of stations is always one more than routes, thus we can initialize preStat
-	// for example, from A to B we take Route 2, there're 2 stations and 1 (1 = 2 - 1) route
-	int preStat = shortPath[0], sufStat;
+void MetroBench::printHeader(ostream &out)
+{
+	out << left << setw(24) << "network" << setw(8) << "engine" << right << setw(10) << "stations" << setw(12) << "load(ms)"
+		<< setw(14) << "prepare(ms)" << setw(12) << "memory(MB)" << setw(10) << "mean(us)" << setw(10) << "p50(us)"
+		<< setw(10) << "p90(us)" << setw(10) << "p99(us)" << setw(10) << "max(us)" << setw(10) << "failed" << endl;
+}
 
-	for (int i = 1; i < init_len; ++i)
+void MetroBench::run(const string &src, const string &engines, int queries, ostream &out)
+{
+	for (string::const_iterator engine = engines.begin(); engine != engines.end(); ++engine)
 	{
-		sufStat = shortPath[i];
+		Metro metro(src);
+		out << left << setw(24) << MetroRegistry::cityName(src) << setw(8) << *engine << right << fixed << setprecision(1);
+		chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+		try { metro.load(); }
+		catch (valueException &ex) { cout << ex.what(); ex.printValue(); cout << endl; return; }
+		double loadMs = elapsedMs(begin);
+		vector<string> names = metro.stationNames();
+		int n = names.size();
+		out << setw(10) << n << setw(12) << loadMs;
 
-		// search the information of station, whose value has been assigned while reading data from txt
-		// now we aim to match the next station's name
-		vector<Station::Node>::iterator nextStatIter = stat[preStat].next.begin();
-		while ((*nextStatIter).nextStat != stat[sufStat].name)
-			++nextStatIter;
-		// after found, then push the route information into the result vector "posRout"
-		posRout.push_back((*nextStatIter).path);
+		if ((*engine == 'f' && n > BENCH_FLOYD_LIMIT) || ((*engine == 'f' || *engine == 'p' || *engine == 's') && n > BENCH_TABLE_LIMIT))
+		{
+			out << setw(14) << "skipped" << endl;
+			continue;
+		}
+		begin = chrono::steady_clock::now();
+		try { metro.build(*engine); }
+		catch (valueException &ex) { out << setw(14) << "failed" << endl; continue; }
+		out << setw(14) << elapsedMs(begin) << setw(12) << metro.memoryUsage() / 1048576.0;
 
-		// then the latter station will become the former one
-		preStat = sufStat;
+		// the same queries for every engine
+		mt19937 random(7);
+		uniform_int_distribution<int> pick(0, n - 1);
+		vector<double> latency;
+		vector<string> stations;
+		int failed = 0;
+		double total = 0;
+		for (int q = 0; q < queries; ++q)
+		{
+			const string &from = names[pick(random)], &to = names[pick(random)];
+			begin = chrono::steady_clock::now();
+			failed += metro.search(from, to, stations) == INF;
+			latency.push_back(elapsedMs(begin) * 1000);
+			total += latency.back();
+		}
+		sort(latency.begin(), latency.end());
+		if (latency.empty())
+			latency.push_back(0);
+		out << setw(10) << total / max(queries, 1) << setw(10) << percentile(latency, 0.5) << setw(10) << percentile(latency, 0.9)
+			<< setw(10) << percentile(latency, 0.99) << setw(10) << latency.back() << setw(10) << failed << endl;
 	}
-	return posRout;
+	out.unsetf(ios::floatfield);
 }
 
-// compute the "best route" by the available routes that we get from the above function
-// there may be 2 or more "best routes", and they'll be completely included in result
-vector<vector<string>> Metro::bestRoutSelect(vector<vector<string>> &myRout)
+/*
+* Self-check of all engines, heap-based Dijkstra is the simplest one and taken as the reference of the others.
+* On a txt file, each check writes a line with the number of mismatches found:
+* 1. routes: every engine searches between random stations, and the distance of the route it gives (walked on the graph by search)
+*    must be that of heap-based Dijkstra, and all entries of the tables as well, line-aware search has no transfer penalty here;
+* 2. changes: the same after each of random closures, reopenings and distances, which every engine repairs in its own way,
+*    and the repaired tables must be the same as tables computed again from scratch, distances are fractional in the second half;
+* 3. snapshot: tables and the hierarchy written into a binary snapshot and loaded back, then changed, which detaches mapped rows;
+* 4. compact: compact tables against tables of double and int, when the network allows compact ones.
+* All the engines are copies of the loaded one and share its network, thus it's checked again after all the changes.
+*/
+class MetroCheck
 {
-	// when empty, then stop
-	if (myRout.size() == 0)
-		return vector<vector<string>>(0);
+private:
+	ostream &out;
+	mt19937 random;
+	int mismatches;
 
-	// resRout stores the result
-	vector<vector<string>> resRout;
-	// preRout means the former route, and sufRout means the latter one
-	vector<string> preRout = *myRout.begin(), sufRout;
+	// distances are sums of the same weights in different orders, thus equal up to rounding
+	static bool same(double a, double b) { return a == b || fabs(a - b) <= 1e-9 * max(1.0, fabs(b)); }
+	// write the line of a check and count its mismatches
+	void report(const string&, char, const char*, int);
+	// routes by search() between random stations against heap-based Dijkstra, and all entries of the tables if computed
+	int checkRoutes(const Metro&);
+	// every entry of the tables against heap-based Dijkstra, and its route walked back by the previous stations
+	int checkTables(const Metro&);
+	// entries of the tables of two engines on the same network
+	int sameTables(const Metro&, const Metro&);
+	// close or reopen a random station or segment, or change the distance of a random segment to whole metres if the last argument is true
+	void randomChange(Metro&, bool);
+	// make random changes on the engine, and check it after each of them
+	int checkChanges(Metro&);
+public:
+	MetroCheck(ostream &o) : out(o), random(7), mismatches(0) {}
+	static void printHeader(ostream&);
+	// check all engines on a txt file, and return the number of mismatches found so far
+	int run(const string&);
+};
 
-	resRout.push_back(preRout);
+void MetroCheck::printHeader(ostream &out)
+{
+	out << left << setw(24) << "network" << setw(8) << "engine" << setw(12) << "check" << right << setw(12) << "mismatches" << endl;
+}
 
-	// screen out the best routes
-	for (vector<vector<string>>::iterator iter = myRout.begin() + 1; iter != myRout.end(); ++iter)
-	{
-		sufRout = *iter;
+void MetroCheck::report(const string &city, char engine, const char *check, int wrong)
+{
+	out << left << setw(24) << city << setw(8) << engine << setw(12) << check << right << setw(12) << wrong << endl;
+	mismatches += wrong;
+}
 
-		// "temp" and "next" are used to record which available routes exist both in the former available routes and the latter available routes
-		// here we use "temp" to store the current ones, and use "next" to store the next ones
-		vector<string> temp = sameElem(preRout, sufRout), next = temp;
+int MetroCheck::checkRoutes(const Metro &metro)
+{
+	vector<string> names = metro.stationNames(), stations;
+	uniform_int_distribution<int> pick(0, names.size() - 1);
+	Metro::QueryScratch &scratch = Metro::threadScratch();
+	int wrong = 0;
+	for (int q = 0; q < CHECK_QUERIES; ++q)
+	{
+		int src = pick(random), des = pick(random);
+		double dis = metro.search(names[src], names[des], stations);
+		bool ends = dis == INF || (stations.front() == names[src] && stations.back() == names[des]);
+		wrong += !ends || !same(dis, metro.heapDijkstra(src, des, scratch));
+	}
+	return wrong + (metro.hasTables() ? checkTables(metro) : 0);
+}
 
-		// when temp is empty (no same route), then transfer, just push it in resRout
-		if (temp.size() == 0)
-			resRout.push_back(sufRout);
-		// when there're same routes
-		else
+int MetroCheck::checkTables(const Metro &metro)
+{
+	const Metro::Graph &graph = metro.net->graph;
+	const vector<double> &weight = metro.edgeWeight();
+	Metro::QueryScratch &scratch = Metro::threadScratch();
+	int n = graph.size(), wrong = 0;
+	for (int i = 0; i < n; ++i)
+	{
+		metro.heapDijkstra(i, -1, scratch);
+		for (int j = 0; j < n; ++j)
 		{
-			// resIter is a iterator of resRout
-			// we insert temp into resRout, and resIter is the inserted position
-			vector<vector<string>>::iterator resIter = resRout.insert(resRout.end(), temp) - 1;
-
-			// search the longest common route
-			while (next.size() != 0 && resIter >= resRout.begin() + 1)
-			{
-				temp = next;
-				next = sameElem(temp, *resIter);
-				--resIter;
-			}
-
-			// adjustment details
-			if (next.size() == 0)
-				resIter += 2;
-			else
+			double dis = metro.tableDis(i, j), walked = 0;
+			int cur = j;
+			for (int steps = 0; dis != INF && cur != i && cur >= 0 && steps < n; ++steps)
 			{
-				temp = next;
-				next = sameElem(temp, *resIter);
-				if (next.size() > 0)
-					temp = next;
-				else
-					++resIter;
+				int prev = metro.tablePrev(i, cur), e = prev < 0 ? -1 : graph.findEdge(prev, cur);
+				walked += e < 0 ? 0 : weight[e];
+				cur = e < 0 ? -1 : prev;
 			}
-
-			// assign the longest common route to relevant members of resRout
-			for (; resIter != resRout.end(); ++resIter)
-				*resIter = temp;
+			wrong += !same(dis, scratch.getDis(j)) || (dis != INF && (cur != i || !same(walked, dis)));
 		}
-		// the latter member will become the former one
-		preRout = sufRout;
 	}
-	return resRout;
+	return wrong;
 }
 
-// sub-function of userAPI, mainly for searching and printing out best route
-void Metro::userSearch()throw(valueException)
+int MetroCheck::sameTables(const Metro &a, const Metro &b)
 {
-	string src, des; // source station name and destination station name
-	cout << endl << "Now input your source:" << endl; cin >> src;
-	cout << endl << "Next input your destination:" << endl; cin >> des;
+	int n = a.net->graph.size(), wrong = 0;
+	for (int i = 0; i < n; ++i)
+		for (int j = 0; j < n; ++j)
+			wrong += !same(a.tableDis(i, j), b.tableDis(i, j));
+	return wrong;
+}
 
-	// if you've chosen Dijkstra algorithm
-	if (alg == 'd' && searchStatNum(src) >= 0)
-		Dijkstra(searchStatNum(src));
-	// search for the whole shortest path
-	int *route = searchRoute(src, des);
-	// if result is empty, then throw exception
-	if (route == nullptr)
+void MetroCheck::randomChange(Metro &metro, bool whole)
+{
+	const Metro::Graph &graph = metro.net->graph;
+	int e = uniform_int_distribution<int>(0, graph.target.size() - 1)(random);
+	string from = metro.getStatName(metro.edgeSource(e)), to = metro.getStatName(graph.target[e]);
+	bool closed = random() % 2 == 0;
+	switch (random() % 3)
 	{
-		cout << "Illegal location!" << endl;
-		throw valueException(src + " " + des);
+	case 0:
+		metro.setStationClosed(from, closed);
+		break;
+	case 1:
+		metro.setSegmentClosed(from, to, closed);
+		break;
+	default:
+		double weight = uniform_int_distribution<int>(100, 5000)(random);
+		metro.setSegmentWeight(from, to, whole ? weight : weight + 0.25);
 	}
+}
 
-	// compute available and then best routes
-	vector<vector<string>> available = availableRoute(route);
-	vector<vector<string>> best = bestRoutSelect(available);
-	// print result out
-	printRoute(route, init_len, best);
-
-	// some more details, including total distance, names of passed stations and their distance
-	cout << endl << endl << "Would like to see all details about passing stations? (y/n)" << endl;
-	char flag; cin >> flag;
-	try
+int MetroCheck::checkChanges(Metro &metro)
+{
+	int wrong = 0;
+	for (int step = 0; step < CHECK_CHANGES; ++step)
 	{
-		if (flag == 'y')
-			// print out details
-			printDetails(route, init_len);
-		else if (flag != 'n')
-			throw valueException(flag);
+		randomChange(metro, step < CHECK_CHANGES / 2);
+		// searches go by bidirectional Dijkstra until the dropped index is built again
+		wrong += checkRoutes(metro);
+		if (metro.indexStale())
+		{
+			metro.rebuildIndex();
+			wrong += checkRoutes(metro);
+		}
+		if (!metro.hasTables())
+			continue;
+		Metro fresh(metro);
+		if (metro.tableAlg == 'f')
+			fresh.Floyd();
+		else
+			fresh.allPairsDijkstra();
+		wrong += sameTables(metro, fresh);
 	}
-	catch (valueException &ex) { cout << ex.what(); ex.printValue(); cout << endl; }
+	return wrong;
 }
 
-// sub-function of userSearch, used to print routes
-void Metro::printRoute(int *route, int routeLen, const vector<vector<string>> &best)
+int MetroCheck::run(const string &src)
 {
-	int cursorStat = 1; // a cursor used to print station and route (cursorStat - 1)
-	cout << endl << "The best route is:" << endl;
-	cout << "Station: " << stat[route[0]].name;
+	string city = MetroRegistry::cityName(src);
+	Metro loaded(src);
+	try { loaded.load(); }
+	catch (valueException &ex) { out << ex.what(); ex.printValue(); out << endl; return ++mismatches; }
 
-	while (cursorStat < routeLen)
+	const char *engines = "dfpbcslr";
+	for (const char *engine = engines; *engine != 0; ++engine)
 	{
-		// search for transfer station
-		while (cursorStat < routeLen - 1 && best[cursorStat - 1] == best[cursorStat])
-			++cursorStat;
+		Metro metro(loaded);
+		metro.transferPenalty = 0;
+		metro.build(*engine);
+		report(city, *engine, "routes", checkRoutes(metro));
+		report(city, *engine, "changes", checkChanges(metro));
+	}
+	report(city, loaded.alg, "unchanged", checkRoutes(loaded));
 
-		// then print out name of route and transfer station
-		cout << " -> Route: " << best[cursorStat - 1][0];
-		for (int temp = 1; temp < (int)best[cursorStat - 1].size(); ++temp)
-			cout << " or " << best[cursorStat - 1][temp]; // there may be more than one best route
-		cout << " -> Station: " << stat[route[cursorStat]].name;
+	// the snapshot is loaded by a Metro of its own, which is destroyed before the file is removed
+	string snapSrc = MetroBench::tempPath(city + ".check.snap");
+	for (const char *engine = "dfpc"; *engine != 0; ++engine)
+	{
+		int wrong = 0;
+		try
+		{
+			Metro metro(loaded);
+			metro.build(*engine);
+			metro.saveSnapshot(snapSrc);
+			Metro back(src);
+			back.load(snapSrc.c_str());
+			back.build(*engine);
+			wrong += back.alg != *engine || back.hasTables() != metro.hasTables();
+			wrong += checkRoutes(back);
+			if (back.hasTables())
+				wrong += sameTables(metro, back);
+			wrong += checkChanges(back);
+		}
+		catch (valueException &ex) { out << ex.what(); ex.printValue(); out << endl; ++wrong; }
+		remove(snapSrc.c_str());
+		report(city, *engine, "snapshot", wrong);
+	}
 
-		++cursorStat;
+	if (!loaded.compactFits())
+		return mismatches;
+	for (const char *engine = "fp"; *engine != 0; ++engine)
+	{
+		Metro compact(loaded), wide(loaded);
+		if (*engine == 'f')
+			compact.Floyd(), wide.Floyd(false);
+		else
+			compact.allPairsDijkstra(), wide.allPairsDijkstra(false);
+		int wrong = compact.compactDis == nullptr || wide.leastDis == nullptr;
+		report(city, *engine, "compact", wrong + checkTables(wide) + sameTables(compact, wide));
 	}
+	return mismatches;
 }
 
-// sub-function of userSearch, used to print details
-void Metro::printDetails(int *route, int routeLen)
+#ifndef _WIN32
+/*
+* Query service on a UNIX domain socket. A request is a line of "city source destination", and the answer is a line of JSON:
+* {"id":0,"city":"...","source":"...","destination":"...","distance":12270,"stations":["...",...],"lines":[["..."],...]}
+* or {"id":0,...,"distance":null,"error":"..."} when it fails. "id" counts requests of a connection from 0.
+* Requests are pipelined: a client may send many lines without waiting, they're answered by all cores at the same time,
+* and the answers are written in the order of requests. Names are written as the bytes in the txt file, only escaped for JSON.
+* A change line of MetroRegistry::change is applied in order as well, and answered by {"id":0,"change":"...","ok":true},
+* or {"id":0,"change":"...","ok":false,"error":"..."}.
+* A request may end with a number k, then at most k (up to MAX_ALTERNATIVES) shortest routes without loops are answered by
+* {"id":0,...,"distance":12270,"alternatives":[{"distance":12270,"transfers":1,"stations":[...],"lines":[...]},...]}.
+* A request ending with "pareto" is answered by the routes of Metro::paretoRoutes in the same form, from the fewest transfers
+* to the shortest: {"id":0,...,"distance":12270,"pareto":[{"distance":13850,"transfers":0,...},...]}.
+* A request ending with a time of "h:mm" asks for the earliest arrival leaving at the time by timetables, answered by
+* {"id":0,...,"departure":29100,"arrival":31260,"transfers":1,"stations":[...],"lines":[...],"times":[...]} in seconds after midnight.
+* A line of "metrics" is answered by {"id":0,"metrics":{"city":{...},...}}, see MetroMetrics::writeJson,
+* and "metrics prometheus" by {"id":0,"prometheus":"..."} whose string is the text exposition for a scraper.
+* A connection is closed once it has sent SERVICE_LINE_LIMIT bytes without ending the line.
+*/
+class MetroService
 {
-	// total distance from source to destination
-	double dis = leastDis[route[0]][route[routeLen - 1]];
+private:
+	// a client connection, it's closed when the reader, the writer and all the requests being answered have released it
+	struct Connection
+	{
+		int fd;
+		mutex lock;
+		condition_variable slot;     // signaled when an answer is written, the reader waits on it when too many are pending
+		condition_variable ready;    // signaled when a request is answered or the reader stops, the writer waits on it
+		map<long long, string> done; // answers which can't be written until the earlier ones are written
+		long long nextWrite;         // id of the next answer to write
+		int pending;                 // requests read but not written yet
+		bool closing;                // the client has stopped sending requests
 
-	// print out total distance
-	cout << endl << "Total distance: (calculated by m)" << endl;
-	cout << dis << endl;
+		Connection(int f) : fd(f), nextWrite(0), pending(0), closing(false) {}
+		~Connection() { ::close(fd); }
+		// keep the answer of a request for the writer
+		void finish(long long, string);
+	};
 
-	// print out names of passed stations
-	cout << endl << "Names of passing stations:" << endl;
-	for_each(route, route + routeLen - 1, [&](int x) {cout << getStatName(x) << " -> "; });
-	cout << getStatName(route[routeLen - 1]) << endl;
+	MetroRegistry &registry;
+	int listenFd;
+	mutex connLock;
+	condition_variable connFree;  // signaled when a connection ends, run waits on it when SERVICE_CONNECTIONS are served
+	int connections;              // connections whose reader is running
 
-	// print out distance between two adjacent stations in the above passed stations
-	cout << endl << "Distance of passing routes: (calculated by m)" << endl;
-	for (int i = 0; i < routeLen - 2; ++i)cout << leastDis[route[i]][route[i + 1]] << " -> ";
-	cout << leastDis[route[routeLen - 2]][route[routeLen - 1]] << endl;
-}
+	// read requests of a connection until it's closed by the client
+	void readLoop(shared_ptr<Connection>);
+	// write answers of a connection in order, thus a slow client never blocks threads of the pool
+	static void writeLoop(shared_ptr<Connection>);
+	// answer a request line in JSON by the engine of its city taken when it was read, nullptr if the city is unknown
+	string answer(long long, const string&, shared_ptr<const Metro>)const;
+	// apply a change line to the registry and answer it in JSON
+	string applyChange(long long, const string&);
+	// apply a reload line to the registry and answer it in JSON when the new engine is in use
+	string applyReload(long long, const string&);
+	// "stations":[...],"lines":[[...],...] of a route
+	static void writeRoute(ostream&, const vector<string>&, const vector<vector<string>>&);
+public:
+	MetroService(MetroRegistry &r) : registry(r), listenFd(-1), connections(0) {}
+	~MetroService() { if (listenFd >= 0) ::close(listenFd); }
 
-// constructors
-// vectors have built-in copy/move constructors and destructors
-Metro::Metro()
+	// create the socket at the path given, return false if failed
+	bool listen(const string&);
+	// accept connections until the socket fails, every connection has a reader thread, and requests are answered on the work-stealing pool
+	// at most SERVICE_CONNECTIONS are served at the same time, and it returns when all of them have ended
+	void run();
+};
+
+bool MetroService::listen(const string &path)
 {
-	leastDis = nullptr;
-	path = nullptr;
+	sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (path.size() >= sizeof(addr.sun_path))
+		return false;
+	strcpy(addr.sun_path, path.c_str());
+	unlink(path.c_str());
+
+	listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+	return listenFd >= 0 && bind(listenFd, (sockaddr*)&addr, sizeof(addr)) == 0 && ::listen(listenFd, SOMAXCONN) == 0;
 }
 
-Metro::Metro(const Metro &a) : stat(a.stat), rout(a.rout), origDis(a.origDis), origPath(a.origPath)
+void MetroService::run()
 {
-	int size = origDis.size();
-	leastDis = new double*[size];
-	path = new int*[size];
-	for (int i = 0; i < size; ++i)
+	// a client which leaves early mustn't kill the service
+	signal(SIGPIPE, SIG_IGN);
+	for (;;)
 	{
-		leastDis[i] = new double[size];
-		path[i] = new int[size];
-		for (int j = 0; j < size; ++j)
 		{
-			leastDis[i][j] = a.leastDis[i][j];
-			path[i][j] = a.path[i][j];
+			unique_lock<mutex> guard(connLock);
+			connFree.wait(guard, [&]() { return connections < SERVICE_CONNECTIONS; });
+		}
+		int fd = accept(listenFd, nullptr, nullptr);
+		// a connection which fails before it's accepted, or a short run out of descriptors, doesn't stop the service
+		if (fd < 0 && (errno == EINTR || errno == ECONNABORTED || errno == EMFILE || errno == ENFILE))
+		{
+			if (errno == EMFILE || errno == ENFILE)
+				this_thread::sleep_for(chrono::milliseconds(100));
+			continue;
+		}
+		if (fd < 0)
+			break;
+		{
+			lock_guard<mutex> guard(connLock);
+			++connections;
 		}
+		thread(&MetroService::readLoop, this, shared_ptr<Connection>(new Connection(fd))).detach();
 	}
+	unique_lock<mutex> guard(connLock);
+	connFree.wait(guard, [&]() { return connections == 0; });
 }
 
-Metro::Metro(Metro &&a) : stat(a.stat), rout(a.rout), origDis(a.origDis), origPath(a.origPath)
+void MetroService::readLoop(shared_ptr<Connection> conn)
 {
-	leastDis = a.leastDis;
-	path = a.path;
-	a.leastDis = nullptr;
-	a.path = nullptr;
+	WorkStealingPool &pool = WorkStealingPool::instance();
+	thread writer(&MetroService::writeLoop, conn);
+	string buffer;
+	char block[4096];
+	long long id = 0;
+	// bytes of the buffer known to hold no newline, thus each byte is scanned once
+	size_t scanned = 0;
+	for (;;)
+	{
+		ssize_t len = read(conn->fd, block, sizeof(block));
+		if (len <= 0)
+			break;
+		buffer.append(block, len);
+
+		// every complete line is a request
+		size_t begin = 0;
+		for (size_t end; (end = buffer.find('\n', max(begin, scanned))) != string::npos; begin = end + 1)
+		{
+			string line = buffer.substr(begin, end - begin);
+			{
+				unique_lock<mutex> guard(conn->lock);
+				conn->slot.wait(guard, [&]() {return conn->pending < SERVICE_PIPELINE; });
+				++conn->pending;
+			}
+			long long cur = id++;
+			// a change is applied before reading the next request, thus requests after it always see it
+			if (MetroRegistry::isChange(line))
+			{
+				conn->finish(cur, applyChange(cur, line));
+				continue;
+			}
+			// a reload is built on the pool like a query, requests after it see the old engine until it's in use
+			if (MetroRegistry::isReload(line))
+			{
+				pool.submit([this, conn, cur, line]() { conn->finish(cur, applyReload(cur, line)); });
+				continue;
+			}
+			// the engine is taken here rather than in the task, since the tasks may run in any order and after later changes
+			string city;
+			istringstream(line) >> city;
+			shared_ptr<const Metro> metro = registry.find(city);
+			pool.submit([this, conn, cur, line, metro]() { conn->finish(cur, answer(cur, line, metro)); });
+		}
+		buffer.erase(0, begin);
+		scanned = buffer.size();
+		// a client which never ends its line isn't served any more
+		if (buffer.size() > SERVICE_LINE_LIMIT)
+			break;
+	}
+
+	{
+		lock_guard<mutex> guard(conn->lock);
+		conn->closing = true;
+	}
+	conn->ready.notify_all();
+	writer.join();
+	// the client gets the end of answers now, though finished tasks of the pool may still hold the connection for a while
+	shutdown(conn->fd, SHUT_RDWR);
+	{
+		lock_guard<mutex> guard(connLock);
+		--connections;
+	}
+	connFree.notify_all();
 }
 
-Metro::~Metro()
+void MetroService::writeLoop(shared_ptr<Connection> conn)
 {
-	int size = origDis.size();
-	for (int i = 0; i < size; ++i)
+	unique_lock<mutex> guard(conn->lock);
+	for (;;)
 	{
-		delete[] leastDis[i];
-		delete[] path[i];
+		conn->ready.wait(guard, [&]() {
+			return (!conn->done.empty() && conn->done.begin()->first == conn->nextWrite) || (conn->closing && conn->pending == 0);
+		});
+		if (conn->done.empty() || conn->done.begin()->first != conn->nextWrite)
+			return;
+		string out = move(conn->done.begin()->second);
+		conn->done.erase(conn->done.begin());
+
+		// the lock isn't held while writing, thus answers keep coming
+		// a failed write means the client has gone, then the rest are dropped
+		guard.unlock();
+		for (size_t sent = 0; sent < out.size();)
+		{
+			ssize_t len = write(conn->fd, out.data() + sent, out.size() - sent);
+			if (len <= 0)
+				break;
+			sent += len;
+		}
+		guard.lock();
+		++conn->nextWrite;
+		--conn->pending;
+		conn->slot.notify_all();
 	}
-	delete[] leastDis;
-	delete[] path;
-	leastDis = nullptr;
-	path = nullptr;
 }
 
-// user API function
-void Metro::userAPI()
+void MetroService::Connection::finish(long long id, string json)
 {
-	// instructions
-	cout << "Welcome to Metro Route System!" << endl << "Our system helps to calculate the best route from source to destination." << endl;
-	cout << endl << "Commands list:" << endl;
-	cout << "search - Search for best route between two stations." << endl;
-	cout << "exit - Leave the Metro Route System." << endl;
+	{
+		lock_guard<mutex> guard(lock);
+		done[id] = move(json);
+	}
+	ready.notify_all();
+}
 
-	// read data from txt
-	initFromTxt();
+string MetroService::answer(long long id, const string &line, shared_ptr<const Metro> metro)const
+{
+	istringstream in(line);
+	string city, src, des, option;
+	in >> city >> src >> des >> option;
+	bool pareto = option == "pareto";
+	bool timed = option.find(':') != string::npos;
+	int k = pareto || timed ? 0 : atoi(option.c_str());
+	int departure = timed ? clockSeconds(option.data(), option.size()) : 0;
 
-	// choose your algorithm
-	cout << endl << "Choose algorithm: Dijkstra or Floyd? (d/f)" << endl; cin >> alg;
-	try
+	ostringstream out;
+	if (city == "metrics")
 	{
-		if (alg == 'f')
+		ostringstream metrics;
+		registry.writeMetrics(metrics, src == "prometheus");
+		out << "{\"id\":" << id;
+		if (src == "prometheus")
 		{
-			// Floyd algorithm takes more time to initialize, thus you may have to wait for a while
-			cout << endl << "Loading... Please wait for a few seconds." << endl;
-			Floyd();
-			cout << endl << "Loading Floyd algorithm complete." << endl;
+			out << ",\"prometheus\":";
+			writeJson(out, metrics.str());
 		}
-		else if (alg != 'd')
+		else
+			out << ",\"metrics\":" << metrics.str();
+		out << "}\n";
+		return out.str();
+	}
+	out.precision(15);
+	out << "{\"id\":" << id << ",\"city\":";
+	writeJson(out, city);
+	out << ",\"source\":";
+	writeJson(out, src);
+	out << ",\"destination\":";
+	writeJson(out, des);
+
+	vector<string> stations;
+	vector<vector<string>> lines;
+	vector<Metro::Itinerary> routes;
+	Metro::Journey journey;
+	const char *error = nullptr;
+	double distance = INF;
+	if (des.empty())
+		error = "a request is a line of \\\"city source destination\\\"";
+	else if (!metro)
+		error = "unknown city";
+	else if (!metro->hasStation(src) || !metro->hasStation(des))
+		error = "unknown station";
+	else if (timed && departure < 0)
+		error = "wrong time";
+	else if (timed && !metro->hasTimetable())
+		error = "no timetable";
+	else if (timed && !metro->earliestArrival(src, des, departure, journey))
+		error = "can't arrive today";
+	else if (timed)
+	{
+		out << ",\"departure\":" << journey.departure << ",\"arrival\":" << journey.arrival << ",\"transfers\":" << journey.transfers << ',';
+		writeRoute(out, journey.stations, journey.lines);
+		out << ",\"times\":[";
+		for (int i = 0; i < (int)journey.times.size(); ++i)
+			out << (i > 0 ? "," : "") << journey.times[i];
+		out << "]}\n";
+		return out.str();
+	}
+	else if (pareto || k > 0)
+	{
+		routes = pareto ? metro->paretoRoutes(src, des) : metro->alternatives(src, des, min(k, MAX_ALTERNATIVES));
+		if (routes.empty())
+			error = "can't arrive";
+		else
+			distance = pareto ? routes.back().distance : routes[0].distance;
+	}
+	else if ((distance = metro->search(src, des, stations, &lines)) == INF)
+		error = "can't arrive";
+	if (error != nullptr)
+	{
+		out << ",\"distance\":null,\"error\":\"" << error << "\"}\n";
+		return out.str();
+	}
+
+	out << ",\"distance\":" << distance;
+	if (!pareto && k <= 0)
+	{
+		out << ',';
+		writeRoute(out, stations, lines);
+		out << "}\n";
+		return out.str();
+	}
+	out << (pareto ? ",\"pareto\":[" : ",\"alternatives\":[");
+	for (int i = 0; i < (int)routes.size(); ++i)
+	{
+		out << (i > 0 ? ",{" : "{") << "\"distance\":" << routes[i].distance << ",\"transfers\":" << routes[i].transfers << ',';
+		writeRoute(out, routes[i].stations, routes[i].lines);
+		out << '}';
+	}
+	out << "]}\n";
+	return out.str();
+}
+
+void MetroService::writeRoute(ostream &out, const vector<string> &stations, const vector<vector<string>> &lines)
+{
+	out << "\"stations\":[";
+	for (int i = 0; i < (int)stations.size(); ++i)
+	{
+		out << (i > 0 ? "," : "");
+		writeJson(out, stations[i]);
+	}
+	out << "],\"lines\":[";
+	for (int i = 0; i < (int)lines.size(); ++i)
+	{
+		out << (i > 0 ? ",[" : "[");
+		for (int j = 0; j < (int)lines[i].size(); ++j)
 		{
-			alg = 'd'; // default: dijkstra
-			throw valueException(alg);
+			out << (j > 0 ? "," : "");
+			writeJson(out, lines[i][j]);
 		}
+		out << "]";
 	}
-	catch (valueException &ex) { cout << ex.what(); ex.printValue(); cout << endl; }
+	out << "]";
+}
 
-	// input your command
-	string command;
-	cout << endl << "Your command:" << endl; cin >> command;
+string MetroService::applyChange(long long id, const string &line)
+{
+	string error = registry.change(line);
+	ostringstream out;
+	out << "{\"id\":" << id << ",\"change\":";
+	writeJson(out, line);
+	if (error.empty())
+		out << ",\"ok\":true}\n";
+	else
+		out << ",\"ok\":false,\"error\":\"" << error << "\"}\n";
+	return out.str();
+}
 
-	// command processing
-	while (command != "exit")
+string MetroService::applyReload(long long id, const string &line)
+{
+	string error = registry.reload(line);
+	ostringstream out;
+	out << "{\"id\":" << id << ",\"reload\":";
+	writeJson(out, line);
+	if (error.empty())
+		out << ",\"ok\":true}\n";
+	else
+		out << ",\"ok\":false,\"error\":\"" << error << "\"}\n";
+	return out.str();
+}
+#endif
+
+/*
+* Usage:
+* Metro                          interactive search on the txt file
+* Metro -w <snapshot> [d/f/p/c]  read the txt file and write a binary snapshot, with tables of Floyd (f) or parallel Dijkstra (p),
+*                                or contraction hierarchies (c)
+* Metro -l <snapshot>            interactive search on a binary snapshot
+* Metro -b <queries>             batch mode, queries are pairs of station names in a file, or standard input for "-"
+* Metro -t <sources> <targets>   write the distance table from station names in a file to those in another, either may be "-"
+* Metro -i <source> <distance>   write stations within the distance of the source station and their distances
+* Metro -r <d/f/p/b/c/s/r> <txt>...  load many cities in parallel, then answer lines of "city source destination" from standard input
+*                                   or apply change lines, such as "close city station" and "weight city from to distance",
+*                                   and a line of "metrics" writes counters of all cities in Prometheus text exposition,
+*                                   while a line of "reload city" reads the txt file again in the background and swaps it in
+* Metro -s <socket> <d/f/p/b/c/s/r> <txt>...  load many cities in the same way, and answer requests on a UNIX domain socket in JSON
+* Metro -g <txt> <stations> [lines] [interchange] [loop] [one-way] [seed]
+*                                write a synthetic network, ratios of interchange stations, loop lines and one-way segments are in [0, 1]
+* Metro -m <engines> <queries> <txt or stations>...  benchmark engines such as "dfpbcs" on txt files,
+*                                or on synthetic networks generated for numbers of stations, e.g. -m dpbcs 10000 100 1000 10000 100000,
+*                                which are written in the temporary directory (TMPDIR or /tmp) and removed afterwards
+* Metro -v [txt or stations]...  check all engines against heap-based Dijkstra, see MetroCheck, on the bundled cities
+*                                and a synthetic network of CHECK_STATIONS stations if nothing is given, it exits with 1 on a mismatch
+* -c <txt> chooses the txt file instead of DEFAULT_SRC, and -l can be combined with -b, -t or -i to answer on a binary snapshot.
+*/
+int main(int argc, char *argv[])
+{
+	const char *snapSrc = nullptr, *writeSrc = nullptr, *batchSrc = nullptr, *txtSrc = DEFAULT_SRC;
+	const char *tableSrc = nullptr, *tableDes = nullptr, *isoSrc = nullptr;
+	double isoRadius = 0;
+	char writeAlg = 'd';
+	for (int i = 1; i < argc; ++i)
 	{
-		if (command == "search")
+		string option = argv[i];
+		if (option == "-r" && i + 1 < argc)
 		{
-			try { userSearch(); }
-			catch (valueException &ex) { cout << ex.what(); ex.printValue(); cout << endl; }
+			MetroRegistry registry;
+			registry.load(vector<string>(argv + i + 2, argv + argc), argv[i + 1][0]);
+			registry.serve(cin, cout);
+			return 0;
+		}
+		else if (option == "-s" && i + 2 < argc)
+		{
+#ifndef _WIN32
+			MetroRegistry registry;
+			registry.load(vector<string>(argv + i + 3, argv + argc), argv[i + 2][0]);
+			MetroService service(registry);
+			if (!service.listen(argv[i + 1]))
+			{
+				cout << "Invalid socket path: " << argv[i + 1] << endl;
+				return 1;
+			}
+			service.run();
+#else
+			cout << "Service mode needs UNIX domain sockets, which aren't supported on this platform." << endl;
+#endif
+			return 0;
+		}
+		else if (option == "-g" && i + 2 < argc)
+		{
+			// optional arguments in order: lines, interchange ratio, loop ratio, one-way ratio, seed
+			NetworkShape shape;
+			shape.stations = atoi(argv[i + 2]);
+			if (i + 3 < argc) shape.lines = atoi(argv[i + 3]);
+			if (i + 4 < argc) shape.interchange = atof(argv[i + 4]);
+			if (i + 5 < argc) shape.loop = atof(argv[i + 5]);
+			if (i + 6 < argc) shape.oneWay = atof(argv[i + 6]);
+			if (i + 7 < argc) shape.seed = (unsigned)atol(argv[i + 7]);
+			if (!NetworkGenerator(shape).write(argv[i + 1]))
+			{
+				cout << "Invalid file directory!" << endl;
+				return 1;
+			}
+			return 0;
+		}
+		else if (option == "-m" && i + 3 < argc)
+		{
+			// a number of stations stands for a synthetic network of default shape,
+			// which is generated in the temporary directory first and removed after its benchmark
+			MetroBench::printHeader(cout);
+			for (int k = i + 3; k < argc; ++k)
+			{
+				string src = argv[k];
+				bool synthetic = src.find_first_not_of("0123456789") == string::npos;
+				if (synthetic)
+				{
+					NetworkShape shape;
+					shape.stations = atoi(argv[k]);
+					src = MetroBench::tempPath("synthetic_" + src + ".txt");
+					if (!NetworkGenerator(shape).write(src))
+					{
+						cout << "Invalid file directory: " << src << endl;
+						return 1;
+					}
+				}
+				MetroBench::run(src, argv[i + 1], atoi(argv[i + 2]), cout);
+				if (synthetic)
+					remove(src.c_str());
+			}
+			return 0;
+		}
+		else if (option == "-v")
+		{
+			// the bundled cities and a synthetic network are checked if no file is given, synthetic ones are written as -m does
+			vector<string> srcs(argv + i + 1, argv + argc);
+			if (srcs.empty())
+				srcs = { "Beijing.txt", "Shanghai.txt", "Tokyo.txt", to_string(CHECK_STATIONS) };
+			MetroCheck check(cout);
+			MetroCheck::printHeader(cout);
+			int mismatches = 0;
+			for (vector<string>::iterator src = srcs.begin(); src != srcs.end(); ++src)
+			{
+				bool synthetic = (*src).find_first_not_of("0123456789") == string::npos;
+				string path = synthetic ? MetroBench::tempPath("synthetic_" + *src + ".txt") : *src;
+				if (synthetic)
+				{
+					NetworkShape shape;
+					shape.stations = atoi((*src).c_str());
+					if (!NetworkGenerator(shape).write(path))
+					{
+						cout << "Invalid file directory: " << path << endl;
+						return 1;
+					}
+				}
+				mismatches = check.run(path);
+				if (synthetic)
+					remove(path.c_str());
+			}
+			cout << (mismatches == 0 ? "All engines agree with heap-based Dijkstra." : "Some engines disagree with heap-based Dijkstra.") << endl;
+			return mismatches == 0 ? 0 : 1;
+		}
+		else if (option == "-c" && i + 1 < argc)
+			txtSrc = argv[++i];
+		else if (option == "-w" && i + 1 < argc)
+		{
+			writeSrc = argv[++i];
+			if (i + 1 < argc && argv[i + 1][0] != '-')
+				writeAlg = argv[++i][0];
+		}
+		else if (option == "-l" && i + 1 < argc)
+			snapSrc = argv[++i];
+		else if (option == "-b" && i + 1 < argc)
+			batchSrc = argv[++i];
+		else if (option == "-t" && i + 2 < argc)
+		{
+			tableSrc = argv[++i];
+			tableDes = argv[++i];
+		}
+		else if (option == "-i" && i + 2 < argc)
+		{
+			isoSrc = argv[++i];
+			isoRadius = atof(argv[++i]);
 		}
 		else
-			cout << endl << "Invalid command." << endl;
-
-		// input command again until you input "exit"
-		cout << endl << "Your command:" << endl; cin >> command;
+		{
+			cout << "Invalid option: " << option << endl;
+			return 1;
+		}
 	}
-}
 
-int main()
-{
-	fileSrc = DEFAULT_SRC; // set txt file source
-	Metro sample;
-	sample.userAPI();
+	Metro sample(txtSrc);
+	if (writeSrc != nullptr)
+		sample.makeSnapshot(writeSrc, writeAlg);
+	else if (batchSrc != nullptr)
+		sample.batchAPI(batchSrc, snapSrc);
+	else if (tableSrc != nullptr)
+		sample.tableAPI(tableSrc, tableDes, snapSrc);
+	else if (isoSrc != nullptr)
+		sample.isochroneAPI(isoSrc, isoRadius, snapSrc);
+	else
+		sample.userAPI(snapSrc);
 	return 0;
 }